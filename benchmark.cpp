@@ -0,0 +1,301 @@
+#include "benchmark.h"
+#include "reactor.h"
+#include "mainwindow.h"
+
+#include <QApplication>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+const double Pi = 3.1415926;
+
+const double benchSpacing = 40, denseSpacing = 12, populatePacking = 0.3;
+const unsigned benchSeed = 1;
+const int wallBenchWidth = 20;
+const double queryHalfSize = 100;
+const int queryK = 16, queryChecks = 50;
+const double paintSpawn = 200; // inside the window's box
+
+static double msPerTick(Reactor& reactor, int nTicks)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int tick = 0; tick < nTicks; ++tick)
+        reactor.advance();
+    return timer.nsecsElapsed() / 1e6 / nTicks;
+}
+
+static double runReorderCase(int nMols, int nTicks, bool reorder)
+{
+    srand(benchSeed);
+
+    // box sized for roughly one molecule per benchSpacing^2, spawned in creation (random) order
+    int width = std::sqrt(nMols) * benchSpacing / 2;
+    Reactor reactor(width);
+    reactor.reorderEnabled = reorder;
+    reactor.addRandomMols(nMols, width * 0.8);
+
+    reactor.advance();
+    return msPerTick(reactor, nTicks);
+}
+
+int runReorderBenchmark(int nMols, int nTicks)
+{
+    printf("%d molecules, %d ticks\n", nMols, nTicks);
+
+    double before = runReorderCase(nMols, nTicks, false);
+    printf("creation order:  %.2lf ms/tick\n", before);
+
+    double after = runReorderCase(nMols, nTicks, true);
+    printf("morton order:    %.2lf ms/tick\n", after);
+
+    printf("speedup:         %.2lfx\n", before / after);
+    return 0;
+}
+
+int runWallBenchmark(int nMols, int nTicks)
+{
+    srand(benchSeed);
+
+    // a small box, so a good share of molecules hits a wall or a corner every tick; only the walls are
+    // used, so the reactors are built from their corners and spawn nothing
+    IntVector TL(-wallBenchWidth, wallBenchWidth, 0), BR(wallBenchWidth, -wallBenchWidth, 0);
+    Reactor scalar(TL, BR), bulk(TL, BR);
+    std::vector<Molecule*> scalarMols, bulkMols;
+    for (int nMol = 0; nMol < nMols; ++nMol)
+    {
+        Molecule* mol = randMolecule(wallBenchWidth);
+        scalarMols.push_back(mol);
+        bulkMols.push_back(newMolecule(mol->type, mol->mass, mol->v, mol->pos));
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int tick = 0; tick < nTicks; ++tick)
+        for (Molecule* mol: scalarMols)
+            scalar.checkWallCollision(mol);
+    double scalarMs = timer.nsecsElapsed() / 1e6 / nTicks;
+
+    // in Reactor::step the gather is shared with the grid build, so it is timed apart from the kernel
+    MolArrays arrays;
+    double copyMs = 0, bulkMs = 0;
+    for (int tick = 0; tick < nTicks; ++tick)
+    {
+        timer.start();
+        arrays.gather(bulkMols);
+        copyMs += timer.nsecsElapsed() / 1e6 / nTicks;
+
+        timer.start();
+        bulk.reflectWalls(arrays);
+        bulkMs += timer.nsecsElapsed() / 1e6 / nTicks;
+
+        timer.start();
+        arrays.scatter(bulkMols);
+        copyMs += timer.nsecsElapsed() / 1e6 / nTicks;
+    }
+
+    int nDiffer = 0;
+    for (int nMol = 0; nMol < nMols; ++nMol)
+    {
+        Molecule *mol = scalarMols[nMol], *mol2 = bulkMols[nMol];
+        if (mol->pos.x != mol2->pos.x || mol->pos.y != mol2->pos.y || mol->v.x != mol2->v.x || mol->v.y != mol2->v.y)
+            ++nDiffer;
+        delete mol;
+        delete mol2;
+    }
+
+    printf("%d molecules, %d ticks\n", nMols, nTicks);
+    printf("scalar:  %.2lf ms/tick, impulse %.6e, heat %.6e\n", scalarMs, scalar.rgtImpulse, scalar.lftHeat);
+    printf("bulk:    %.2lf ms/tick, impulse %.6e, heat %.6e\n", bulkMs, bulk.rgtImpulse, bulk.lftHeat);
+    printf("gather and scatter: %.2lf ms/tick\n", copyMs);
+    printf("molecules differing from the scalar reference: %d\n", nDiffer);
+    return nDiffer ? 1 : 0;
+}
+
+static int countOverlaps(const std::vector<Molecule*>& mols, int width)
+{
+    MolArrays arrays;
+    arrays.gather(mols);
+    MolGrid grid;
+    grid.build(arrays, IntVector(-width, width, 0), IntVector(width, -width, 0), 2 * molRadius(1));
+
+    int nOverlaps = 0;
+    for (int nMol = 0; nMol < arrays.size; ++nMol)
+    {
+        grid.visitNear(grid.molCell[nMol], [&](int nMol2)
+        {
+            double dx = arrays.x[nMol2] - arrays.x[nMol], dy = arrays.y[nMol2] - arrays.y[nMol];
+            double d = arrays.r[nMol] + arrays.r[nMol2];
+            if (nMol2 > nMol && dx * dx + dy * dy < d * d) ++nOverlaps;
+            return true;
+        });
+    }
+    return nOverlaps;
+}
+
+static int runPopulateCase(int nMols, double packing, int width)
+{
+    const char* names[] = {"lattice", "jittered", "poisson"};
+    printf("%d molecules, packing %.2lf, box %d\n", nMols, packing, 2 * width);
+
+    int nFailed = 0;
+    for (int placement = PLACE_LATTICE; placement <= PLACE_POISSON; ++placement)
+    {
+        PopulationSpec spec;
+        spec.placement = Placement(placement);
+        spec.packing = packing;
+        spec.seed = benchSeed;
+
+        QElapsedTimer timer;
+        timer.start();
+        std::vector<Molecule*> mols = generatePopulation(nMols, Vector(-width, -width, 0), Vector(width, width, 0),
+                                                         spec, std::vector<Molecule*>());
+        double ms = timer.nsecsElapsed() / 1e6;
+
+        Vector momentum;
+        double kinetic = 0;
+        for (Molecule* mol: mols)
+        {
+            momentum += mol->v * mol->mass;
+            kinetic += mol->mass * (mol->v ^ mol->v) / 2;
+        }
+        int nOverlaps = countOverlaps(mols, width);
+
+        printf("%-9s %7.1lf ms, %zu placed, %d overlaps, momentum (%.1e, %.1e), kT %.4lf\n", names[placement], ms,
+               mols.size(), nOverlaps, momentum.x, momentum.y, kinetic / std::max<int>(mols.size() - 1, 1));
+        if (nOverlaps || int(mols.size()) < nMols) ++nFailed;
+
+        for (Molecule* mol: mols)
+            delete mol;
+    }
+    return nFailed;
+}
+
+int runPopulateBenchmark(int nMols)
+{
+    // a box with room for half the target packing, so the generator has to shrink the region
+    double r = molRadius(1);
+    int nFailed = runPopulateCase(nMols, populatePacking, std::sqrt(nMols * Pi * r * r / (populatePacking / 2)) / 2 + 1);
+
+    // packing 0 spreads over the whole region, as spawning does: a sparse box, then one only just big enough
+    nFailed += runPopulateCase(nMols, 0, std::sqrt(nMols) * benchSpacing / 2);
+    nFailed += runPopulateCase(nMols, 0, std::sqrt(nMols) * denseSpacing / 2);
+    return nFailed ? 1 : 0;
+}
+
+static Vector randQueryPos(double width)
+{
+    return Vector((2.0 * rand() / RAND_MAX - 1) * width, (2.0 * rand() / RAND_MAX - 1) * width, 0);
+}
+
+// Times each query kind against the grid left by the last tick, then checks a few answers by brute force
+int runQueryBenchmark(int nMols, int nQueries)
+{
+    srand(benchSeed);
+
+    int width = std::sqrt(nMols) * benchSpacing / 2;
+    Reactor reactor(width);
+    reactor.addRandomMols(nMols, width * 0.8);
+    reactor.step();
+
+    std::vector<Molecule*> all = reactor.molsInRect(Vector(-2 * width, -2 * width, 0), Vector(2 * width, 2 * width, 0));
+    printf("%zu molecules, %d queries of each kind\n", all.size(), nQueries);
+
+    Vector half(queryHalfSize, queryHalfSize, 0);
+    std::vector<Vector> points(nQueries);
+    for (Vector& point: points)
+        point = randQueryPos(width * 0.8);
+
+    QElapsedTimer timer;
+    size_t nFound = 0;
+    timer.start();
+    for (Vector point: points)
+        nFound += reactor.molsInRect(point - half, point + half).size();
+    printf("rect %.0lfx%.0lf:  %.1lf us, %.1lf found\n", 2 * queryHalfSize, 2 * queryHalfSize,
+           timer.nsecsElapsed() / 1e3 / nQueries, double(nFound) / nQueries);
+
+    nFound = 0;
+    timer.start();
+    for (Vector point: points)
+        nFound += reactor.molsInCircle(point, queryHalfSize).size();
+    printf("circle r %.0lf:   %.1lf us, %.1lf found\n", queryHalfSize, timer.nsecsElapsed() / 1e3 / nQueries,
+           double(nFound) / nQueries);
+
+    timer.start();
+    for (Vector point: points)
+        reactor.nearestMols(point, queryK);
+    printf("%d nearest:     %.1lf us\n", queryK, timer.nsecsElapsed() / 1e3 / nQueries);
+
+    // aim at molecule centres, so every pick has an answer
+    std::vector<Vector> targets(nQueries);
+    for (int nQuery = 0; nQuery < nQueries; ++nQuery)
+        targets[nQuery] = all[rand() % all.size()]->pos;
+    int nHit = 0;
+    timer.start();
+    for (Vector target: targets)
+        nHit += reactor.molAt(target) != nullptr;
+    printf("pick:           %.1lf us, %d of %d hit\n", timer.nsecsElapsed() / 1e3 / nQueries, nHit, nQueries);
+
+    int nWrong = nHit < nQueries;
+    for (int nCheck = 0; nCheck < std::min(queryChecks, nQueries); ++nCheck)
+    {
+        Vector point = points[nCheck];
+        std::vector<Molecule*> inRect, inCircle;
+        std::vector<std::pair<double, Molecule*>> byDist;
+        for (Molecule* mol: all)
+        {
+            Vector delta = mol->pos - point;
+            double dist2 = delta.x * delta.x + delta.y * delta.y;
+            if (std::abs(delta.x) <= queryHalfSize && std::abs(delta.y) <= queryHalfSize) inRect.push_back(mol);
+            if (dist2 <= queryHalfSize * queryHalfSize) inCircle.push_back(mol);
+            byDist.push_back({dist2, mol});
+        }
+        std::sort(byDist.begin(), byDist.end());
+
+        std::vector<Molecule*> rect = reactor.molsInRect(point - half, point + half);
+        std::vector<Molecule*> circle = reactor.molsInCircle(point, queryHalfSize);
+        std::vector<Molecule*> nearest = reactor.nearestMols(point, queryK);
+        std::sort(rect.begin(), rect.end());
+        std::sort(inRect.begin(), inRect.end());
+        std::sort(circle.begin(), circle.end());
+        std::sort(inCircle.begin(), inCircle.end());
+
+        bool nearestOk = int(nearest.size()) == std::min<int>(queryK, all.size());
+        for (int nNear = 0; nearestOk && nNear < int(nearest.size()); ++nNear)
+        {
+            // ties may come in either order, so compare distances rather than molecules
+            Vector delta = nearest[nNear]->pos - point;
+            nearestOk = delta.x * delta.x + delta.y * delta.y == byDist[nNear].first;
+        }
+        if (rect != inRect || circle != inCircle || !nearestOk) ++nWrong;
+    }
+    printf("answers differing from brute force: %d\n", nWrong);
+    return nWrong ? 1 : 0;
+}
+
+// The window as it runs interactively, ticked by the reactor's own timer, first with every item drawn straight
+// into the view and then with the caches the items set up. Times are the view's running average.
+int runPaintBenchmark(int nMols, int nFrames)
+{
+    printf("%d molecules added to the window's, %d frames\n", nMols, nFrames);
+
+    for (bool cached: {false, true})
+    {
+        srand(benchSeed);
+        MainWindow window;
+        if (!cached) window.uncacheItems();
+        window.reactor->addRandomMols(nMols, paintSpawn);
+        window.show();
+
+        int nFrame = 0;
+        QObject::connect(window.reactor, &Reactor::stepped, &window, [&nFrame, nFrames]
+        {
+            if (++nFrame == nFrames) QApplication::quit();
+        });
+        QApplication::exec();
+        printf("%-9s %.2lf ms/frame\n", cached ? "cached:" : "uncached:", window.paintMs());
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// Headless per-tick timings, printed to stdout. Started from main() by a command line switch.
+int runReorderBenchmark(int nMols, int nTicks);
+int runWallBenchmark(int nMols, int nTicks);
+int runPopulateBenchmark(int nMols);
+int runQueryBenchmark(int nMols, int nQueries);
+int runPaintBenchmark(int nMols, int nFrames);
+
+#endif // BENCHMARK_H
@@ -0,0 +1,36 @@
+#include "cachedlayer.h"
+
+#include <QPainter>
+
+CachedLayer::CachedLayer(QGraphicsItem* owner, std::function<QRectF()> bounds, std::function<void(QPainter*)> draw)
+    : QGraphicsItem(owner)
+{
+    this->bounds = bounds;
+    this->draw = draw;
+
+    // drawn under the owner's dynamic content, in the owner's coordinates
+    setFlag(QGraphicsItem::ItemStacksBehindParent);
+    setCacheMode(QGraphicsItem::DeviceCoordinateCache);
+}
+
+QRectF CachedLayer::boundingRect() const
+{
+    return bounds();
+}
+
+void CachedLayer::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    painter->save();
+    draw(painter);
+    painter->restore();
+}
+
+void CachedLayer::prepareChange()
+{
+    prepareGeometryChange();
+}
+
+void CachedLayer::refresh()
+{
+    update();
+}
@@ -0,0 +1,27 @@
+#ifndef CACHEDLAYER_H
+#define CACHEDLAYER_H
+
+#include <QGraphicsItem>
+
+#include <functional>
+
+// A static part of an item (walls, axes, tick marks) drawn by its owner into a device-coordinate cache.
+// The owner can update() itself every frame, the layer is only redrawn after refresh().
+// Whoever changes what bounds() or draw() read calls prepareChange() before the change and refresh() after it.
+class CachedLayer : public QGraphicsItem
+{
+public:
+    CachedLayer(QGraphicsItem* owner, std::function<QRectF()> bounds, std::function<void(QPainter*)> draw);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+    void prepareChange();
+    void refresh();
+
+private:
+    std::function<QRectF()> bounds;
+    std::function<void(QPainter*)> draw;
+};
+
+#endif // CACHEDLAYER_H
@@ -0,0 +1,139 @@
+#include "checks.h"
+#include "reactor.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+const int refineCheckWidth = 250, refineCheckWeight = 40;
+const double refineCheckX = 240, refineCheckRing = 70; // the copies ring lies about this far out
+const int budgetCheckPairs = 12, budgetCheckMaxMols = 4; // at most maxCoarseParts fragments per explosion
+
+// Opens up the molecules so a scenario can be laid out by hand
+class CheckReactor : public Reactor
+{
+public:
+    CheckReactor(int width) : Reactor(width)
+    {
+        for (Molecule* mol: mols)
+            delete mol;
+        mols.clear();
+    }
+
+    using Reactor::mols;
+};
+
+// A heavy super-particle next to the right wall, with a few neighbours in the way of its ring
+static int checkRefineNearWall()
+{
+    srand(1);
+    CheckReactor reactor(refineCheckWidth);
+    Molecule* heavy = newMolecule(MOL_ROUND, 1, Vector(1, 0, 0), Vector(refineCheckX, 0, 0));
+    heavy->weight = refineCheckWeight;
+    reactor.mols.push_back(heavy);
+    for (int nMol = 0; nMol < 4; ++nMol)
+        reactor.mols.push_back(newMolecule(MOL_SQUARE, 1, Vector(0, 1, 0), Vector(refineCheckX - refineCheckRing, nMol * 12 - 18, 0)));
+
+    int weightBefore = 0;
+    for (Molecule* mol: reactor.mols)
+        weightBefore += mol->weight;
+    reactor.refineMols(refineCheckWeight * 2);
+
+    int nOutside = 0, nOverlaps = 0, weightAfter = 0;
+    int nMols = reactor.mols.size();
+    for (int nMol = 0; nMol < nMols; ++nMol)
+    {
+        Molecule* mol = reactor.mols[nMol];
+        weightAfter += mol->weight;
+        if (mol->pos.x - mol->r < -refineCheckWidth || mol->pos.x + mol->r > refineCheckWidth ||
+            mol->pos.y - mol->r < -refineCheckWidth || mol->pos.y + mol->r > refineCheckWidth)
+            ++nOutside;
+
+        for (int nMol2 = nMol + 1; nMol2 < nMols; ++nMol2)
+        {
+            Vector delta = mol->pos - reactor.mols[nMol2]->pos;
+            double R = mol->r + reactor.mols[nMol2]->r;
+            if (delta.x * delta.x + delta.y * delta.y < R * R) ++nOverlaps;
+        }
+    }
+
+    printf("refine near wall: %d molecules, weight %d -> %d, %d outside, %d overlapping pairs\n", nMols,
+           weightBefore, weightAfter, nOutside, nOverlaps);
+    return nOutside || nOverlaps || weightAfter != weightBefore || nMols == 5 ? 1 : 0;
+}
+
+// Square pairs of masses 2 and 3 collide head-on above the budget, an explosion of 5 parts, which is prime
+static int checkBudgetPrime()
+{
+    srand(1);
+    CheckReactor reactor(refineCheckWidth);
+    reactor.molBudget = budgetCheckPairs;
+    for (int nPair = 0; nPair < budgetCheckPairs; ++nPair)
+    {
+        double y = nPair * 30 - 165;
+        reactor.mols.push_back(newMolecule(MOL_SQUARE, 2, Vector(2, 0, 0), Vector(-8, y, 0)));
+        reactor.mols.push_back(newMolecule(MOL_SQUARE, 3, Vector(-2, 0, 0), Vector(8, y, 0)));
+    }
+
+    int massBefore = 0, massAfter = 0;
+    Vector momentumBefore, momentumAfter;
+    for (Molecule* mol: reactor.mols)
+    {
+        massBefore += mol->weight * mol->mass;
+        momentumBefore += mol->v * (mol->weight * mol->mass);
+    }
+    reactor.step();
+    int nSquares = 0;
+    for (Molecule* mol: reactor.mols)
+    {
+        massAfter += mol->weight * mol->mass;
+        momentumAfter += mol->v * (mol->weight * mol->mass);
+        nSquares += mol->type == MOL_SQUARE;
+    }
+
+    Vector drift = momentumAfter - momentumBefore;
+    int nMols = reactor.mols.size();
+    printf("budget with prime parts: %d molecules from %d explosions, %d squares left, mass %d -> %d, momentum drift %g\n",
+           nMols, budgetCheckPairs, nSquares, massBefore, massAfter, std::sqrt(drift.x * drift.x + drift.y * drift.y));
+    return nSquares == 0 && nMols <= budgetCheckPairs * budgetCheckMaxMols && massAfter == massBefore &&
+           std::abs(drift.x) < 1e-3 && std::abs(drift.y) < 1e-3 ? 0 : 1;
+}
+
+static int countRemoved(CheckReactor& reactor)
+{
+    int nRemoved = 0;
+    for (Molecule* mol: reactor.mols)
+        nRemoved += mol->status == MOL_INVALID;
+    return nRemoved;
+}
+
+// Removing more molecules than are left, from an empty box and in steps that must not pick a molecule twice
+static int checkRemoveMols()
+{
+    srand(1);
+    CheckReactor reactor(refineCheckWidth);
+    reactor.addRandomMols(-3);
+    int emptyRemoved = countRemoved(reactor);
+
+    for (int nMol = 0; nMol < 10; ++nMol)
+        reactor.mols.push_back(newMolecule(MOL_ROUND, 1, Vector(), Vector(nMol * 20 - 90, 0, 0)));
+    reactor.addRandomMols(-4);
+    reactor.addRandomMols(-4);
+    int stepRemoved = countRemoved(reactor);
+    reactor.addRandomMols(-5);
+    int allRemoved = countRemoved(reactor);
+
+    printf("remove mols: %d from an empty box, 8 of 10 in two steps: %d, then the rest: %d\n", emptyRemoved,
+           stepRemoved, allRemoved);
+    return emptyRemoved == 0 && stepRemoved == 8 && allRemoved == 10 ? 0 : 1;
+}
+
+int runCheck(const char* name)
+{
+    if (!strcmp(name, "refine-near-wall")) return checkRefineNearWall();
+    if (!strcmp(name, "remove-mols")) return checkRemoveMols();
+    if (!strcmp(name, "budget-prime")) return checkBudgetPrime();
+
+    fprintf(stderr, "unknown check %s\n", name);
+    return 2;
+}
@@ -0,0 +1,8 @@
+#ifndef CHECKS_H
+#define CHECKS_H
+
+// Headless self-checking scenarios, started from main() by --check NAME and registered with ctest.
+// Each prints what it found and returns 0 when it passes.
+int runCheck(const char* name);
+
+#endif // CHECKS_H
@@ -0,0 +1,107 @@
+#include "fields.h"
+#include "wallkernel.h"
+#include "parallel.h"
+
+#include <cmath>
+
+// per-cell sums: weight, mass, x and y momentum, twice the kinetic energy
+const int nCellSums = 5;
+// speed distributions are predicted per mass, heavier molecules share the last class
+const int nMassClasses = 16;
+
+FieldBins::FieldBins()
+{
+    this->tick = -1;
+    this->kT = 0;
+    resize(32, 32, 50, 25);
+}
+
+void FieldBins::resize(int nx, int ny, int nSpeedBins, double maxSpeed)
+{
+    this->nx = nx;
+    this->ny = ny;
+    this->nSpeedBins = nSpeedBins;
+    this->maxSpeed = maxSpeed;
+
+    density.assign(nx * ny, 0);
+    temperature.assign(nx * ny, 0);
+    speeds.assign(nSpeedBins, 0);
+    maxwell.assign(nSpeedBins, 0);
+}
+
+void FieldBins::bin(const MolArrays& arrays, IntVector TL, IntVector BR, long long tick)
+{
+    this->tick = tick;
+
+    int nCells = nx * ny, nSums = nCells * nCellSums + nSpeedBins + nMassClasses;
+    double cellW = double(BR.x - TL.x) / nx, cellH = double(TL.y - BR.y) / ny, speedStep = maxSpeed / nSpeedBins;
+
+    int nChunks = parallelChunks(arrays.size);
+    partial.resize(nChunks);
+    parallelFor(arrays.size, [&](int nChunk, int begin, int end)
+    {
+        std::vector<double>& sums = partial[nChunk];
+        sums.assign(nSums, 0);
+        double *cells = sums.data(), *speedSums = cells + nCells * nCellSums, *massSums = speedSums + nSpeedBins;
+
+        for (int nMol = begin; nMol < end; ++nMol)
+        {
+            double w = arrays.weight[nMol], m = arrays.mass[nMol], vx = arrays.vx[nMol], vy = arrays.vy[nMol];
+            double v2 = vx * vx + vy * vy;
+            int cx = std::min(std::max(int((arrays.x[nMol] - TL.x) / cellW), 0), nx - 1);
+            int cy = std::min(std::max(int((TL.y - arrays.y[nMol]) / cellH), 0), ny - 1);
+
+            double* cell = cells + (cy * nx + cx) * nCellSums;
+            cell[0] += w;
+            cell[1] += w * m;
+            cell[2] += w * m * vx;
+            cell[3] += w * m * vy;
+            cell[4] += w * m * v2;
+
+            int speedBin = std::min(int(std::sqrt(v2) / speedStep), nSpeedBins - 1);
+            speedSums[speedBin] += w;
+            massSums[std::min(int(m), nMassClasses) - 1] += w;
+        }
+    });
+
+    // reduce over chunks, each thread owning a range of cells
+    std::vector<double> totals(nSums, 0);
+    parallelFor(nSums, [&](int, int begin, int end)
+    {
+        for (const std::vector<double>& sums: partial)
+            for (int nSum = begin; nSum < end; ++nSum)
+                totals[nSum] += sums[nSum];
+    });
+
+    double twiceKinetic = 0, totalW = 0;
+    for (int nCell = 0; nCell < nCells; ++nCell)
+    {
+        double* cell = totals.data() + nCell * nCellSums;
+        density[nCell] = cell[0] / (cellW * cellH);
+
+        // kinetic energy around the cell's mean flow, shared between 2 degrees of freedom per molecule
+        double flow = cell[1] > 0 ? (cell[2] * cell[2] + cell[3] * cell[3]) / cell[1] : 0;
+        temperature[nCell] = cell[0] > 0 ? (cell[4] - flow) / (2 * cell[0]) : 0;
+
+        twiceKinetic += cell[4];
+        totalW += cell[0];
+    }
+    kT = totalW > 0 ? twiceKinetic / (2 * totalW) : 0;
+
+    // 2D Maxwell-Boltzmann speed CDF per mass class: 1 - exp(-m v^2 / 2kT)
+    const double* speedSums = totals.data() + nCells * nCellSums;
+    const double* massSums = speedSums + nSpeedBins;
+    for (int nBin = 0; nBin < nSpeedBins; ++nBin)
+    {
+        speeds[nBin] = speedSums[nBin];
+        maxwell[nBin] = 0;
+        if (kT <= 0) continue;
+
+        double lo = nBin * speedStep, hi = nBin == nSpeedBins - 1 ? INFINITY : lo + speedStep;
+        for (int nClass = 0; nClass < nMassClasses; ++nClass)
+        {
+            double m = nClass + 1;
+            maxwell[nBin] += massSums[nClass] * (std::exp(-m * lo * lo / (2 * kT)) - std::exp(-m * hi * hi / (2 * kT)));
+        }
+    }
+}
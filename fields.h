@@ -0,0 +1,32 @@
+#ifndef FIELDS_H
+#define FIELDS_H
+
+#include "myvector.h"
+
+#include <vector>
+
+class MolArrays;
+
+// Density and temperature on a coarse grid over the box plus the speed distribution, binned from molecule state.
+// Fields are row-major starting from the top-left cell. Temperatures are kT with k = 1, 2D.
+class FieldBins
+{
+public:
+    FieldBins();
+    void resize(int nx, int ny, int nSpeedBins, double maxSpeed);
+
+    // One pass over the molecules into per-thread partial sums, then a reduction over the bins
+    void bin(const MolArrays& arrays, IntVector TL, IntVector BR, long long tick);
+
+    int nx, ny, nSpeedBins;
+    double maxSpeed, kT;
+    long long tick; // tick the fields were binned at, -1 before the first pass
+
+    std::vector<double> density, temperature; // molecules per unit area, local kT around the cell's mean flow
+    std::vector<double> speeds, maxwell;      // molecules per speed bin, measured and Maxwell-Boltzmann at kT
+
+private:
+    std::vector<std::vector<double>> partial;
+};
+
+#endif // FIELDS_H
@@ -0,0 +1,56 @@
+#include "heatmapitem.h"
+
+#include <QPainter>
+
+#include <algorithm>
+
+const int borderWidth = 1, labelX = 3, labelY = 12;
+
+HeatmapItem::HeatmapItem(Vector lowColor, Vector highColor, IntVector TL, IntVector BR)
+{
+    this->width = BR.x - TL.x;
+    this->height = TL.y - BR.y;
+    this->setPos((TL.x + BR.x) / 2, -(TL.y + BR.y) / 2);
+
+    this->lowColor = lowColor;
+    this->highColor = highColor;
+    this->maxValue = 0;
+
+    // repainted from the cache until the next field arrives
+    setCacheMode(QGraphicsItem::DeviceCoordinateCache);
+}
+
+QRectF HeatmapItem::boundingRect() const
+{
+    return QRectF(-width / 2 - 1, -height / 2 - 1, width + 2, height + 2);
+}
+
+void HeatmapItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    painter->save();
+    if (!image.isNull())
+        painter->drawImage(QRectF(-width / 2, -height / 2, width, height), image);
+
+    painter->setPen(QPen(QBrush(Qt::black), borderWidth));
+    painter->setBrush(Qt::transparent);
+    painter->drawRect(-width / 2, -height / 2, width, height);
+    painter->drawText(-width / 2 + labelX, -height / 2 + labelY, QString::number(maxValue, 'g', 3));
+    painter->restore();
+}
+
+void HeatmapItem::setField(int nx, int ny, std::vector<double> values)
+{
+    maxValue = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+
+    image = QImage(nx, ny, QImage::Format_RGB32);
+    for (int cy = 0; cy < ny; ++cy)
+    {
+        for (int cx = 0; cx < nx; ++cx)
+        {
+            double share = maxValue > 0 ? std::max(values[cy * nx + cx], 0.0) / maxValue : 0;
+            Vector color = lowColor + (highColor - lowColor) * share;
+            image.setPixel(cx, cy, qRgb(255 * color.x, 255 * color.y, 255 * color.z));
+        }
+    }
+    update();
+}
@@ -0,0 +1,28 @@
+#ifndef HEATMAPITEM_H
+#define HEATMAPITEM_H
+
+#include "myvector.h"
+
+#include <QGraphicsObject>
+#include <QImage>
+
+// A scalar field on a grid drawn as a cached image, scaled to the largest value
+class HeatmapItem : public QGraphicsObject
+{
+    Q_OBJECT
+public:
+    HeatmapItem(Vector lowColor, Vector highColor, IntVector TL, IntVector BR);
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+public slots:
+    void setField(int nx, int ny, std::vector<double> values);
+
+private:
+    int width, height;
+    Vector lowColor, highColor;
+    double maxValue;
+    QImage image;
+};
+
+#endif // HEATMAPITEM_H
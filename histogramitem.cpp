@@ -0,0 +1,66 @@
+#include "histogramitem.h"
+
+#include <QPainter>
+
+#include <algorithm>
+
+const int axisWidth = 3, borderWidth = 1, pointSize = 3, margin = 10;
+
+HistogramItem::HistogramItem(QColor barColor, QColor refColor, IntVector TL, IntVector BR)
+{
+    this->width = BR.x - TL.x;
+    this->height = TL.y - BR.y;
+    this->setPos((TL.x + BR.x) / 2, -(TL.y + BR.y) / 2);
+
+    this->barColor = barColor;
+    this->refColor = refColor;
+
+    setCacheMode(QGraphicsItem::DeviceCoordinateCache);
+}
+
+QRectF HistogramItem::boundingRect() const
+{
+    return QRectF(-width / 2 - 1, -height / 2 - 1, width + 2, height + 2);
+}
+
+void HistogramItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    painter->save();
+    painter->setBrush(Qt::transparent);
+
+    painter->setPen(QPen(QBrush(Qt::black), borderWidth));
+    painter->drawRect(-width / 2, -height / 2, width, height);
+    painter->setPen(QPen(QBrush(Qt::black), axisWidth));
+    painter->drawLine(-width / 2, height / 2 - margin, width / 2, height / 2 - margin);
+
+    double top = 0;
+    for (double value: measured)
+        top = std::max(top, value);
+    for (double value: reference)
+        top = std::max(top, value);
+
+    int nBins = measured.size();
+    if (top > 0 && nBins)
+    {
+        double binWidth = (width - 2.0 * margin) / nBins, yScale = (height - 2.0 * margin) / top;
+        double x0 = -width / 2 + margin, y0 = height / 2 - margin;
+
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(barColor);
+        for (int nBin = 0; nBin < nBins; ++nBin)
+            painter->drawRect(QRectF(x0 + nBin * binWidth, y0 - measured[nBin] * yScale, binWidth, measured[nBin] * yScale));
+
+        painter->setPen(QPen(QBrush(refColor), pointSize));
+        for (int nBin = 0; nBin < int(reference.size()) && nBin < nBins; ++nBin)
+            painter->drawPoint(x0 + (nBin + 0.5) * binWidth, y0 - reference[nBin] * yScale);
+    }
+
+    painter->restore();
+}
+
+void HistogramItem::setBins(std::vector<double> measured, std::vector<double> reference)
+{
+    this->measured = measured;
+    this->reference = reference;
+    update();
+}
@@ -0,0 +1,26 @@
+#ifndef HISTOGRAMITEM_H
+#define HISTOGRAMITEM_H
+
+#include "myvector.h"
+
+#include <QGraphicsObject>
+
+// Bars of a measured distribution with a reference distribution drawn over them, scaled to the tallest bin
+class HistogramItem : public QGraphicsObject
+{
+    Q_OBJECT
+public:
+    HistogramItem(QColor barColor, QColor refColor, IntVector TL, IntVector BR);
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+public slots:
+    void setBins(std::vector<double> measured, std::vector<double> reference);
+
+private:
+    int width, height;
+    QColor barColor, refColor;
+    std::vector<double> measured, reference;
+};
+
+#endif // HISTOGRAMITEM_H
@@ -1,13 +1,54 @@
 #include "mainwindow.h"
+#include "benchmark.h"
+#include "snapshot.h"
+#include "protocol.h"
+#include "checks.h"
+#ifdef REACTOR_SLABS
+#include "slab.h"
+#endif
 
 #include <QApplication>
 
+#include <cstring>
+
 int main(int argc, char *argv[])
 {
     srand(1);
 
+#ifdef REACTOR_SLABS
+    // workers are forked before any Qt state exists in this process
+    if (argc > 2 && !strcmp(argv[1], "--slabs"))
+        return runSlabs(argc, argv, atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 5000,
+                        argc > 4 ? atoi(argv[4]) : 1000000, argc > 5 ? atoi(argv[5]) : 100);
+#endif
+
+    if (argc > 2 && !strcmp(argv[1], "--publish"))
+        return runPublisher(argc, argv, argv[2], argc > 3 ? atoi(argv[3]) : 250);
+
+    if (argc > 2 && !strcmp(argv[1], "--run"))
+        return runProtocol(argc, argv, argv[2]);
+
+    // benchmarks and checks build reactors, and so widgets, but never show them
+    if (argc > 1 && (!strncmp(argv[1], "--bench-", strlen("--bench-")) || !strcmp(argv[1], "--check")))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
     QApplication a(argc, argv);
-    MainWindow w;
+
+    if (argc > 2 && !strcmp(argv[1], "--check"))
+        return runCheck(argv[2]);
+
+    if (argc > 1 && !strcmp(argv[1], "--bench-reorder"))
+        return runReorderBenchmark(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : 10);
+    if (argc > 1 && !strcmp(argv[1], "--bench-walls"))
+        return runWallBenchmark(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : 100);
+    if (argc > 1 && !strcmp(argv[1], "--bench-populate"))
+        return runPopulateBenchmark(argc > 2 ? atoi(argv[2]) : 1000000);
+    if (argc > 1 && !strcmp(argv[1], "--bench-queries"))
+        return runQueryBenchmark(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : 1000);
+    if (argc > 1 && !strcmp(argv[1], "--bench-paint"))
+        return runPaintBenchmark(argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atoi(argv[3]) : 300);
+
+    MainWindow w(nullptr, argc > 2 && !strcmp(argv[1], "--view") ? argv[2] : "",
+                 argc > 2 && !strcmp(argv[1], "--protocol") ? argv[2] : "");
 
     w.show();
     return a.exec();
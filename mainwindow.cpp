@@ -1,36 +1,163 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "reactor.h"
+#include "snapshot.h"
 
+#include <QElapsedTimer>
 #include <QGraphicsView>
+#include <QPaintEvent>
 #include <QTimer>
 
-const int edge = 250;
+#include <cstdio>
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow)
+const int edge = 250, molBudget = 20000, fieldPeriod = 10;
+const int paintReportMs = 500;
+const double paintSmoothing = 0.05;
+
+// Keeps a running average of the time the view spends painting one frame
+class SceneView : public QGraphicsView
+{
+public:
+    double paintMs = 0;
+
+protected:
+    void paintEvent(QPaintEvent* event) override
+    {
+        QElapsedTimer timer;
+        timer.start();
+        QGraphicsView::paintEvent(event);
+        paintMs += (timer.nsecsElapsed() / 1e6 - paintMs) * paintSmoothing;
+    }
+};
+
+MainWindow::MainWindow(QWidget *parent, QString snapshotSource, QString protocolPath)
+    : QMainWindow(parent), ui(new Ui::MainWindow)
 {
+    protocol = nullptr;
+    reactor = nullptr;
     ui->setupUi(this);
 
-    QGraphicsView* view = new QGraphicsView();
+    // static items are cached, so per frame only the molecules and the graph series are dirty;
+    // every bounding rect already includes its pen, so the view need not pad them for antialiasing
+    view = new SceneView();
     scene = new QGraphicsScene;
     view->setScene(scene);
+    view->setOptimizationFlag(QGraphicsView::DontAdjustForAntialiasing);
     setCentralWidget(view);
 
-    Reactor* reactor = new Reactor(edge);
-    scene->addItem(reactor);
+    QLabel* paintLabel = new QLabel();
+    QTimer* paintReport = new QTimer(this);
+    QObject::connect(paintReport, &QTimer::timeout, paintLabel, [this, paintLabel]
+    {
+        paintLabel->setText(QString("paint %1 ms/frame").arg(paintMs(), 0, 'f', 2));
+    });
+    paintReport->start(paintReportMs);
+    ui->statusbar->addPermanentWidget(paintLabel);
+
+    // a protocol builds the reactor exactly as runProtocol does, so both runs give the same numbers
+    if (snapshotSource.isEmpty() && !protocolPath.isEmpty())
+    {
+        protocol = new Protocol();
+        if (!protocol->load(protocolPath.toStdString()))
+        {
+            fprintf(stderr, "%s\n", protocol->error.c_str());
+            delete protocol;
+            protocol = nullptr;
+        }
+    }
 
-    energyGraph = new PlaneItem(1, {Qt::black}, 0.05, 200, {edge + 5, edge, 0}, {2 * edge + 5, 5, 0});
-    countGraph = new PlaneItem(2, {Qt::blue, Qt::red}, 0.4, 100, {edge + 5, 0, 0}, {2 * edge + 5, -edge, 0});
+    // graphs right of the box, fields under it; a viewer learns its box only from the frames and assumes the default
+    int width = protocol ? protocol->width : edge;
+    energyGraph = new PlaneItem(1, {Qt::black}, 0.05, 200, {width + 5, edge, 0}, {width + edge + 5, 5, 0});
+    countGraph = new PlaneItem(2, {Qt::blue, Qt::red}, 0.4, 100, {width + 5, 0, 0}, {width + edge + 5, -edge, 0});
     scene->addItem(energyGraph);
     scene->addItem(countGraph);
 
+    if (!snapshotSource.isEmpty())
+    {
+        // viewer mode: the simulation runs in another process and streams frames to us
+        SnapshotView* snapshotView = new SnapshotView(snapshotSource);
+        scene->addItem(snapshotView);
+
+        QObject::connect(snapshotView, &SnapshotView::energySig, energyGraph, &PlaneItem::addPoint);
+        QObject::connect(snapshotView, &SnapshotView::molCntSig, countGraph, &PlaneItem::addPoint);
+
+        QLabel* frameLabel = new QLabel();
+        QObject::connect(snapshotView, &SnapshotView::frameSig, frameLabel, [frameLabel](long long tick, long long nMissed)
+        {
+            frameLabel->setText(QString("tick %1, missed %2").arg(tick).arg(nMissed));
+        });
+        ui->statusbar->addWidget(frameLabel);
+        return;
+    }
+
+    if (protocol)
+    {
+        srand(protocol->seed);
+        reactor = new Reactor(protocol->width);
+        reactor->molBudget = protocol->budget;
+        reactor->protocol = protocol;
+        QObject::connect(reactor, &Reactor::protocolStopped, this, [this](QString reason)
+        {
+            ui->statusbar->showMessage("protocol stopped: " + reason);
+        });
+    }
+    else
+    {
+        reactor = new Reactor(edge);
+        reactor->molBudget = molBudget;
+    }
+    scene->addItem(reactor);
+
     QObject::connect(reactor, &Reactor::energySig, energyGraph, &PlaneItem::addPoint);
     QObject::connect(reactor, &Reactor::molCntSig, countGraph, &PlaneItem::addPoint);
 
+    // fields under the reactor: density, temperature and the speed distribution against Maxwell-Boltzmann
+    reactor->fieldPeriod = fieldPeriod;
+    densityMap = new HeatmapItem(Vector(1, 1, 1), Vector(0, 0, 0.6), {-width, -width - 5, 0}, {-5, -2 * width, 0});
+    temperatureMap = new HeatmapItem(Vector(0, 0, 0.6), Vector(1, 0.2, 0), {5, -width - 5, 0}, {width, -2 * width, 0});
+    speedGraph = new HistogramItem(Qt::gray, Qt::red, {width + 5, -width - 5, 0}, {width + edge + 5, -width - edge, 0});
+    scene->addItem(densityMap);
+    scene->addItem(temperatureMap);
+    scene->addItem(speedGraph);
+
+    QObject::connect(reactor, &Reactor::fieldsSig, this, [this](const FieldBins& fields)
+    {
+        densityMap->setField(fields.nx, fields.ny, fields.density);
+        temperatureMap->setField(fields.nx, fields.ny, fields.temperature);
+        speedGraph->setBins(fields.speeds, fields.maxwell);
+    });
+
+    // click a molecule to inspect it; a probe down the middle counts crossings each way
+    QLabel* inspectLabel = new QLabel();
+    QObject::connect(reactor, &Reactor::molInspected, inspectLabel, &QLabel::setText);
+
+    int probe = reactor->addProbe(Vector(0, -width, 0), Vector(0, width, 0));
+    QLabel* probeLabel = new QLabel();
+    QObject::connect(reactor, &Reactor::stepped, probeLabel, [this, probe, probeLabel]
+    {
+        const LineProbe& counts = reactor->probes[probe];
+        probeLabel->setText(QString("x = 0: %1 right, %2 left").arg(counts.forward).arg(counts.backward));
+    });
+
     ui->statusbar->addWidget(reactor->d);
+    ui->statusbar->addWidget(inspectLabel);
+    ui->statusbar->addPermanentWidget(probeLabel);
 }
 
 MainWindow::~MainWindow()
 {
+    delete protocol;
     delete ui;
 }
+
+double MainWindow::paintMs() const
+{
+    return view->paintMs;
+}
+
+void MainWindow::uncacheItems()
+{
+    for (QGraphicsItem* item: scene->items())
+        item->setCacheMode(QGraphicsItem::NoCache);
+}
@@ -2,6 +2,9 @@
 #define MAINWINDOW_H
 
 #include "planeitem.h"
+#include "heatmapitem.h"
+#include "histogramitem.h"
+#include "protocol.h"
 
 #include <QMainWindow>
 #include <QGraphicsScene>
@@ -12,18 +15,30 @@ class MainWindow;
 }
 QT_END_NAMESPACE
 
+class Reactor;
+class SceneView;
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    MainWindow(QWidget *parent = nullptr, QString snapshotSource = QString(), QString protocolPath = QString());
     ~MainWindow();
 
+    double paintMs() const; // the view's running average paint time per frame, as shown in the status bar
+    void uncacheItems();    // every item is drawn straight into the view from now on, to time the scene without caches
+
+    Reactor* reactor; // nullptr in viewer mode
+
 private:
     Ui::MainWindow *ui;
     QGraphicsScene* scene;
+    SceneView* view;
 
     PlaneItem *energyGraph, *countGraph;
+    HeatmapItem *densityMap, *temperatureMap;
+    HistogramItem* speedGraph;
+    Protocol* protocol;
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,96 @@
+#include "molgrid.h"
+#include "wallkernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int maxCellsPerAxis = 1 << 16;
+const double maxCellsPerMol = 4;
+
+static uint64_t spreadBits(uint64_t a)
+{
+    a &= 0xffffffff;
+    a = (a | (a << 16)) & 0x0000ffff0000ffff;
+    a = (a | (a << 8))  & 0x00ff00ff00ff00ff;
+    a = (a | (a << 4))  & 0x0f0f0f0f0f0f0f0f;
+    a = (a | (a << 2))  & 0x3333333333333333;
+    a = (a | (a << 1))  & 0x5555555555555555;
+    return a;
+}
+
+MolGrid::MolGrid()
+{
+    this->cellSize = this->cellW = this->cellH = 1;
+    this->nx = this->ny = 0;
+    this->periodicX = this->periodicY = false;
+    this->locality = 1;
+}
+
+int MolGrid::cellX(double x) const
+{
+    int cx = std::floor((x - origin.x) / cellW);
+    return std::clamp(cx, 0, nx - 1);
+}
+
+int MolGrid::cellY(double y) const
+{
+    int cy = std::floor((y - origin.y) / cellH);
+    return std::clamp(cy, 0, ny - 1);
+}
+
+int MolGrid::cellIndex(double x, double y) const
+{
+    return cellY(y) * nx + cellX(x);
+}
+
+int MolGrid::cellIndex(Vector pos) const
+{
+    return cellIndex(pos.x, pos.y);
+}
+
+uint64_t MolGrid::mortonCode(int cell) const
+{
+    return spreadBits(cell % nx) | (spreadBits(cell / nx) << 1);
+}
+
+void MolGrid::build(const MolArrays& arrays, IntVector TL, IntVector BR, double minCellSize, bool periodicX,
+                    bool periodicY)
+{
+    int nMols = arrays.size;
+    double width = std::max(BR.x - TL.x, 1), height = std::max(TL.y - BR.y, 1);
+
+    // keep the number of cells proportional to the population so sparse boxes stay cheap
+    double maxCells = std::max(maxCellsPerMol * nMols, 1.0);
+    cellSize = std::max(minCellSize, std::sqrt(width * height / maxCells));
+    cellSize = std::max(cellSize, std::max(width, height) / (maxCellsPerAxis - 1));
+    nx = periodicX ? std::max(int(width / cellSize), 1) : int(width / cellSize) + 1;
+    ny = periodicY ? std::max(int(height / cellSize), 1) : int(height / cellSize) + 1;
+    cellW = periodicX ? width / nx : cellSize;
+    cellH = periodicY ? height / ny : cellSize;
+    origin = Vector(TL.x, BR.y, 0);
+    this->periodicX = periodicX;
+    this->periodicY = periodicY;
+
+    molCell.resize(nMols);
+    cellStart.assign(nx * ny + 1, 0);
+    for (int nMol = 0; nMol < nMols; ++nMol)
+    {
+        molCell[nMol] = cellIndex(arrays.x[nMol], arrays.y[nMol]);
+        ++cellStart[molCell[nMol] + 1];
+    }
+    for (int cell = 0; cell < nx * ny; ++cell)
+        cellStart[cell + 1] += cellStart[cell];
+
+    cellMols.resize(nMols);
+    std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    int nNear = 0;
+    for (int nMol = 0; nMol < nMols; ++nMol)
+    {
+        cellMols[fill[molCell[nMol]]++] = nMol;
+
+        if (nMol == 0) continue;
+        int cell = molCell[nMol], prev = molCell[nMol - 1];
+        if (std::abs(cell % nx - prev % nx) <= 1 && std::abs(cell / nx - prev / nx) <= 1) ++nNear;
+    }
+    locality = nMols > 1 ? double(nNear) / (nMols - 1) : 1;
+}
@@ -0,0 +1,66 @@
+#ifndef MOLGRID_H
+#define MOLGRID_H
+
+#include "myvector.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+class MolArrays;
+
+// Uniform grid over the reactor box, rebuilt once per tick with a counting sort.
+// Cells are at least as wide as the largest distance two molecules can close in one tick,
+// so collision candidates of a molecule are always in its own or the 8 adjacent cells.
+// Along periodic axes the cells tile the box exactly and neighbours wrap around.
+class MolGrid
+{
+public:
+    MolGrid();
+
+    void build(const MolArrays& arrays, IntVector TL, IntVector BR, double minCellSize, bool periodicX = false,
+               bool periodicY = false);
+
+    int cellX(double x) const;
+    int cellY(double y) const;
+    int cellIndex(Vector pos) const;
+    int cellIndex(double x, double y) const;
+
+    // calls visit(index) for the molecules of the 3x3 cells around cell until visit returns false
+    template <class Visit> void visitNear(int cell, Visit visit) const;
+
+    // Morton (Z-order) code of a cell, used to lay molecules out along a space-filling curve
+    uint64_t mortonCode(int cell) const;
+
+    double cellSize;   // requested edge
+    double cellW, cellH; // actual edges, stretched along periodic axes
+    Vector origin;
+    int nx, ny;
+    bool periodicX, periodicY;
+
+    std::vector<int> cellStart; // cellMols[cellStart[c] .. cellStart[c + 1]) are in cell c
+    std::vector<int> cellMols;  // molecule indices grouped by cell, in storage order inside a cell
+    std::vector<int> molCell;   // cell of every molecule
+
+    // share of molecules whose storage predecessor lies in the same or an adjacent cell
+    double locality;
+};
+
+template <class Visit> void MolGrid::visitNear(int cell, Visit visit) const
+{
+    // narrow periodic axes are already covered without wrapping
+    bool wrapX = periodicX && nx >= 3, wrapY = periodicY && ny >= 3;
+    int cx = cell % nx, cy = cell / nx;
+    for (int y = wrapY ? cy - 1 : std::max(cy - 1, 0); y <= (wrapY ? cy + 1 : std::min(cy + 1, ny - 1)); ++y)
+    {
+        int wy = y < 0 ? y + ny : y >= ny ? y - ny : y;
+        for (int x = wrapX ? cx - 1 : std::max(cx - 1, 0); x <= (wrapX ? cx + 1 : std::min(cx + 1, nx - 1)); ++x)
+        {
+            int near = wy * nx + (x < 0 ? x + nx : x >= nx ? x - nx : x);
+            for (int nEntry = cellStart[near]; nEntry < cellStart[near + 1]; ++nEntry)
+                if (!visit(cellMols[nEntry])) return;
+        }
+    }
+}
+
+#endif // MOLGRID_H
@@ -0,0 +1,31 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+const int minParallelChunk = 4096;
+
+// Number of contiguous chunks parallelFor splits n items into, one per worker thread
+inline int parallelChunks(int n)
+{
+    int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    return std::max(1, std::min(nThreads, n / minParallelChunk));
+}
+
+// Calls body(nChunk, begin, end) for every chunk, the first one on the calling thread
+template <class Body> void parallelFor(int n, Body body)
+{
+    int nChunks = parallelChunks(n);
+
+    std::vector<std::thread> threads;
+    for (int nChunk = 1; nChunk < nChunks; ++nChunk)
+        threads.emplace_back(body, nChunk, int(int64_t(n) * nChunk / nChunks), int(int64_t(n) * (nChunk + 1) / nChunks));
+    body(0, 0, int(int64_t(n) / nChunks));
+    for (std::thread& thread: threads)
+        thread.join();
+}
+
+#endif // PARALLEL_H
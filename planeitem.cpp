@@ -22,6 +22,8 @@ PlaneItem::PlaneItem(int nGraphs, std::vector<QColor> colors, double yScale, dou
     this->yScale = yScale;
     this->cutStepX = 10;
     this->cutStepY = cutStepY;
+
+    frame = new CachedLayer(this, [this]{ return boundingRect(); }, [this](QPainter* painter){ drawFrame(painter); });
 }
 
 QRectF PlaneItem::boundingRect() const
@@ -56,9 +58,8 @@ void PlaneItem::drawGraphs(QPainter* painter)
     }
 }
 
-void PlaneItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+void PlaneItem::drawFrame(QPainter* painter)
 {
-    painter->save();
     painter->setPen(QPen(QBrush(Qt::black), axisWidth));
     painter->setBrush(Qt::transparent);
 
@@ -69,8 +70,13 @@ void PlaneItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
     painter->drawRect(-width / 2, -height / 2, width, height);
 
     drawCuts(painter);
-    drawGraphs(painter);
+}
 
+// only the series, the frame underneath comes from its cache
+void PlaneItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    painter->save();
+    drawGraphs(painter);
     painter->restore();
 }
 
@@ -2,6 +2,7 @@
 #define PLANEITEM_H
 
 #include "myvector.h"
+#include "cachedlayer.h"
 
 #include <QGraphicsObject>
 
@@ -13,6 +14,7 @@ public:
     QRectF boundingRect() const override;
 
     void drawCuts(QPainter *painter);
+    void drawFrame(QPainter* painter);
     void drawGraphs(QPainter* painter);
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
 
@@ -32,6 +34,7 @@ private:
     int nGraphs, nPoints;
     std::vector<std::vector<double>> points;
     std::vector<QColor> colors;
+    CachedLayer* frame; // axes, border and cuts, drawn once
 };
 
 #endif // PLANEITEM_H
@@ -0,0 +1,299 @@
+#include "populate.h"
+#include "reactor.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+const double Pi = 3.1415926;
+const double clearance = 1.1; // neighbour distance over the sum of radii
+const int poissonRounds = 8, poissonDarts = 1;
+const double poissonSpread = 0.7; // disc spacing over sqrt(area per molecule) when spreading, gives ~1.4 nMols discs
+const double poissonJamming = 0.5; // random dart throwing stalls near 55% coverage of the spacing discs
+
+static uint64_t splitMix(uint64_t& state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static double uniform(uint64_t& state) { return (splitMix(state) >> 11) * (1.0 / (1ull << 53)); }
+
+static double gaussian(uint64_t& state)
+{
+    double u1 = uniform(state), u2 = uniform(state);
+    return std::sqrt(-2 * std::log(1 - u1)) * std::cos(2 * Pi * u2);
+}
+
+// every item gets its own stream, so results do not depend on the number of threads
+static uint64_t itemSeed(unsigned seed, uint64_t item, uint64_t salt)
+{
+    uint64_t state = (uint64_t(seed) << 32) ^ (item * 0x2545f4914f6cdd1d) ^ (salt << 56);
+    splitMix(state);
+    return state;
+}
+
+PopulationSpec::PopulationSpec()
+{
+    this->placement = PLACE_POISSON;
+    this->packing = 0;
+    this->temperature = 1;
+    this->maxMass = 1;
+    this->seed = 1;
+}
+
+Obstacles::Obstacles(const std::vector<Molecule*>& existing, Vector lo, Vector hi, double newR)
+{
+    this->newR = newR;
+    this->addedCell = 2 * newR * clearance;
+    arrays.gather(existing);
+    if (!arrays.size) return;
+
+    double maxR = *std::max_element(arrays.r.begin(), arrays.r.end());
+    grid.build(arrays, IntVector(lo.x, hi.y, 0), IntVector(hi.x + 1, lo.y - 1, 0), (maxR + newR) * clearance);
+}
+
+bool Obstacles::blocked(double x, double y) const
+{
+    return blocked(x, y, newR);
+}
+
+bool Obstacles::blocked(double x, double y, double r) const
+{
+    bool hit = false;
+    if (arrays.size)
+    {
+        grid.visitNear(grid.cellIndex(x, y), [&](int nMol)
+        {
+            double dx = arrays.x[nMol] - x, dy = arrays.y[nMol] - y, d = (arrays.r[nMol] + r) * clearance;
+            hit = dx * dx + dy * dy < d * d;
+            return !hit;
+        });
+    }
+    if (hit || added.empty()) return hit;
+
+    int64_t cx = std::floor(x / addedCell), cy = std::floor(y / addedCell);
+    for (int64_t y2 = cy - 1; y2 <= cy + 1; ++y2)
+        for (int64_t x2 = cx - 1; x2 <= cx + 1; ++x2)
+        {
+            auto cell = added.find(addedKey(x2, y2));
+            if (cell == added.end()) continue;
+            for (const Vector& mol: cell->second)
+            {
+                double dx = mol.x - x, dy = mol.y - y, d = (mol.z + r) * clearance;
+                if (dx * dx + dy * dy < d * d) return true;
+            }
+        }
+    return false;
+}
+
+void Obstacles::add(double x, double y, double r)
+{
+    added[addedKey(std::floor(x / addedCell), std::floor(y / addedCell))].push_back(Vector(x, y, r));
+}
+
+int64_t Obstacles::addedKey(int64_t cx, int64_t cy)
+{
+    return int64_t((uint64_t(cx) << 32) ^ uint32_t(cy));
+}
+
+static std::vector<Vector> latticeSites(int nMols, Vector lo, Vector hi, const PopulationSpec& spec, double r,
+                                        const Obstacles& obstacles)
+{
+    double width = hi.x - lo.x, height = hi.y - lo.y, minStep = 2 * r * clearance;
+    double step = spec.packing > 0 ? r * std::sqrt(Pi / spec.packing) : std::sqrt(width * height / nMols);
+    step = std::max(step, minStep);
+
+    int nCols = std::max(1, int(width / step) + 1), nRows = std::max(1, int(height / step) + 1);
+    while (int64_t(nCols) * nRows < nMols && step > minStep)
+    {
+        step = std::max(minStep, step * 0.98);
+        nCols = std::max(1, int(width / step) + 1);
+        nRows = std::max(1, int(height / step) + 1);
+    }
+    nCols = std::max(1, std::min(nCols, int(width / step) + 1));
+
+    // centre the lattice and pull it in so the outer molecules stay inside the region
+    int nSites = nCols * nRows;
+    Vector origin = Vector(lo.x + (width - (nCols - 1) * step) / 2, lo.y + (height - (nRows - 1) * step) / 2, 0);
+    double jitter = spec.placement == PLACE_JITTERED ? (step - minStep) / 2 : 0;
+
+    std::vector<Vector> sites(nSites);
+    std::vector<char> free(nSites);
+    parallelFor(nSites, [&](int, int begin, int end)
+    {
+        for (int nSite = begin; nSite < end; ++nSite)
+        {
+            uint64_t state = itemSeed(spec.seed, nSite, 1);
+            Vector site = origin + Vector(nSite % nCols, nSite / nCols, 0) * step;
+            if (jitter > 0) site += Vector(jitter * (2 * uniform(state) - 1), jitter * (2 * uniform(state) - 1), 0);
+
+            sites[nSite] = site;
+            free[nSite] = site.x >= lo.x && site.x <= hi.x && site.y >= lo.y && site.y <= hi.y &&
+                          !obstacles.blocked(site.x, site.y);
+        }
+    });
+
+    std::vector<Vector> chosen;
+    chosen.reserve(nMols);
+    for (int nSite = 0; nSite < nSites && int(chosen.size()) < nMols; ++nSite)
+        if (free[nSite]) chosen.push_back(sites[nSite]);
+    return chosen;
+}
+
+// Parallel dart throwing on a background grid (one point per cell). Cells of one of 9 colours
+// are 3 cells apart, more than the disc radius, so a whole colour can be filled concurrently.
+static std::vector<Vector> poissonSites(int nMols, Vector lo, Vector hi, const PopulationSpec& spec, double r,
+                                        const Obstacles& obstacles)
+{
+    // spreading over the whole region: space the discs for nMols, so the work follows nMols and not the area
+    double width = hi.x - lo.x, height = hi.y - lo.y;
+    double minDist = 2 * r * clearance;
+    if (spec.packing <= 0) minDist = std::max(minDist, poissonSpread * std::sqrt(width * height / nMols));
+    double cellSize = minDist / std::sqrt(2.0);
+    int nx = std::max(1, int(std::ceil(width / cellSize))), ny = std::max(1, int(std::ceil(height / cellSize)));
+
+    std::vector<double> px(int64_t(nx) * ny), py(int64_t(nx) * ny);
+    std::vector<char> filled(int64_t(nx) * ny, 0);
+
+    auto fits = [&](int cx, int cy, double x, double y)
+    {
+        for (int y2 = std::max(cy - 2, 0); y2 <= std::min(cy + 2, ny - 1); ++y2)
+        {
+            for (int x2 = std::max(cx - 2, 0); x2 <= std::min(cx + 2, nx - 1); ++x2)
+            {
+                // corner cells of the 5x5 block are at least minDist away
+                int cell = y2 * nx + x2;
+                if (std::abs(x2 - cx) == 2 && std::abs(y2 - cy) == 2) continue;
+                if (!filled[cell]) continue;
+                double dx = px[cell] - x, dy = py[cell] - y;
+                if (dx * dx + dy * dy < minDist * minDist) return false;
+            }
+        }
+        return !obstacles.blocked(x, y);
+    };
+
+    // further rounds only top up a sample that came out too sparse for nMols
+    int colourX = (nx + 2) / 3, colourY = (ny + 2) / 3;
+    for (int round = 0; round < poissonRounds && std::count(filled.begin(), filled.end(), 1) < nMols; ++round)
+    {
+        for (int colour = 0; colour < 9; ++colour)
+        {
+            parallelFor(colourX * colourY, [&](int, int begin, int end)
+            {
+                for (int nCell = begin; nCell < end; ++nCell)
+                {
+                    int cx = nCell % colourX * 3 + colour % 3, cy = nCell / colourX * 3 + colour / 3;
+                    if (cx >= nx || cy >= ny || filled[cy * nx + cx]) continue;
+
+                    uint64_t state = itemSeed(spec.seed, cy * nx + cx, 2 + round);
+                    for (int dart = 0; dart < poissonDarts; ++dart)
+                    {
+                        double x = std::min(lo.x + (cx + uniform(state)) * cellSize, hi.x);
+                        double y = std::min(lo.y + (cy + uniform(state)) * cellSize, hi.y);
+                        if (!fits(cx, cy, x, y)) continue;
+
+                        px[cy * nx + cx] = x;
+                        py[cy * nx + cx] = y;
+                        filled[cy * nx + cx] = 1;
+                        break;
+                    }
+                }
+            });
+        }
+    }
+
+    std::vector<int> cells;
+    for (int cell = 0; cell < nx * ny; ++cell)
+        if (filled[cell]) cells.push_back(cell);
+
+    // a maximal sample is denser than asked for, thin it out uniformly (this leaves it in random order)
+    if (int(cells.size()) > nMols)
+    {
+        uint64_t state = itemSeed(spec.seed, 0, 0xff);
+        for (int nChosen = 0; nChosen < nMols; ++nChosen)
+            std::swap(cells[nChosen], cells[nChosen + splitMix(state) % (cells.size() - nChosen)]);
+        cells.resize(nMols);
+    }
+
+    std::vector<Vector> chosen;
+    chosen.reserve(cells.size());
+    for (int cell: cells)
+        chosen.push_back(Vector(px[cell], py[cell], 0));
+    return chosen;
+}
+
+std::vector<Molecule*> generatePopulation(int nMols, Vector lo, Vector hi, const PopulationSpec& spec,
+                                          const std::vector<Molecule*>& existing)
+{
+    if (nMols <= 0) return {};
+
+    // room for the largest molecule of the batch, then shrink to the requested packing
+    double r = molRadius(spec.maxMass);
+    lo += Vector(r, r, 0);
+    hi -= Vector(r, r, 0);
+    if (hi.x < lo.x || hi.y < lo.y) return {};
+
+    double width = hi.x - lo.x, height = hi.y - lo.y;
+    double scale = spec.packing > 0 ? std::sqrt(nMols * Pi * r * r / spec.packing / std::max(width * height, 1.0)) : 1;
+    if (scale < 1)
+    {
+        Vector centre = (lo + hi) / 2, half = Vector(width, height, 0) * (scale / 2);
+        lo = centre - half;
+        hi = centre + half;
+    }
+
+    // past the jamming coverage dart throwing cannot reach nMols, so a region that tight gets a jittered lattice,
+    // as does one where obstacles left the sample short
+    Obstacles obstacles(existing, lo - Vector(r, r, 0), hi + Vector(r, r, 0), r);
+    double minDist = 2 * r * clearance;
+    double area = std::max((hi.x - lo.x) * (hi.y - lo.y), 1.0);
+    bool jammed = nMols * Pi * minDist * minDist / 4 > poissonJamming * area;
+    std::vector<Vector> sites;
+    if (spec.placement == PLACE_POISSON && !jammed) sites = poissonSites(nMols, lo, hi, spec, r, obstacles);
+    if (int(sites.size()) < nMols)
+    {
+        PopulationSpec latticeSpec = spec;
+        if (spec.placement == PLACE_POISSON) latticeSpec.placement = PLACE_JITTERED;
+        std::vector<Vector> fallback = latticeSites(nMols, lo, hi, latticeSpec, r, obstacles);
+        if (fallback.size() > sites.size()) sites.swap(fallback);
+    }
+
+    int nPlaced = sites.size();
+    std::vector<Molecule*> mols(nPlaced);
+    parallelFor(nPlaced, [&](int, int begin, int end)
+    {
+        for (int nMol = begin; nMol < end; ++nMol)
+        {
+            uint64_t state = itemSeed(spec.seed, nMol, 0x80);
+            bool round = splitMix(state) % 2;
+            int mass = round ? 1 : 1 + splitMix(state) % spec.maxMass;
+            double sigma = std::sqrt(spec.temperature / mass);
+
+            Vector v = Vector(sigma * gaussian(state), sigma * gaussian(state), 0);
+            mols[nMol] = newMolecule(round ? MOL_ROUND : MOL_SQUARE, mass, v, sites[nMol]);
+        }
+    });
+
+    // remove the drift of the batch, then rescale to exactly (N - 1) kT of kinetic energy (2D, momentum fixed)
+    Vector momentum;
+    double totalMass = 0, kinetic = 0;
+    for (Molecule* mol: mols)
+    {
+        momentum += mol->v * mol->mass;
+        totalMass += mol->mass;
+    }
+    for (Molecule* mol: mols)
+    {
+        mol->v -= momentum / totalMass;
+        kinetic += mol->mass * (mol->v ^ mol->v) / 2;
+    }
+    if (kinetic > 0)
+        for (Molecule* mol: mols)
+            mol->v *= std::sqrt((nPlaced - 1) * spec.temperature / kinetic);
+
+    return mols;
+}
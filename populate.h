@@ -0,0 +1,60 @@
+#ifndef POPULATE_H
+#define POPULATE_H
+
+#include "myvector.h"
+#include "molgrid.h"
+#include "wallkernel.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class Molecule;
+
+enum Placement
+{
+    PLACE_LATTICE,
+    PLACE_JITTERED,
+    PLACE_POISSON
+};
+
+class PopulationSpec
+{
+public:
+    PopulationSpec();
+
+    Placement placement;
+    double packing;     // share of the area covered by the new molecules, 0 to spread them over the whole region
+    double temperature; // kT of the Maxwell-Boltzmann velocities (k = 1)
+    int maxMass;        // squares weigh 1..maxMass, rounds always 1
+    unsigned seed;
+};
+
+// Creates up to nMols molecules inside [lo, hi] that overlap neither each other nor `existing`.
+// Fewer come back when the region cannot hold them. Net momentum of the batch is zero and its
+// kinetic energy matches the temperature exactly. Work is split over all hardware threads.
+std::vector<Molecule*> generatePopulation(int nMols, Vector lo, Vector hi, const PopulationSpec& spec,
+                                          const std::vector<Molecule*>& existing);
+
+// Molecules already in the reactor, looked up through a grid, plus any added one by one since.
+// Molecules tested or added must not be larger than newR.
+class Obstacles
+{
+public:
+    Obstacles(const std::vector<Molecule*>& existing, Vector lo, Vector hi, double newR);
+
+    bool blocked(double x, double y) const; // for a molecule of radius newR
+    bool blocked(double x, double y, double r) const;
+    void add(double x, double y, double r);
+
+private:
+    static int64_t addedKey(int64_t cx, int64_t cy);
+
+    MolArrays arrays;
+    MolGrid grid;
+    double newR;
+    double addedCell;
+    std::unordered_map<int64_t, std::vector<Vector>> added; // (x, y, r) by cell
+};
+
+#endif // POPULATE_H
@@ -0,0 +1,208 @@
+#include "protocol.h"
+#include "reactor.h"
+
+#include <QApplication>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static const char* observables[] = {"tick", "energy", "round", "square", "mols", "kt", "temp", "impulse", "heat",
+                                    "outflow"};
+
+static bool parsePolicy(const std::string& name, WallPolicy* policy)
+{
+    static const char* names[] = {"reflect", "thermostat", "periodic", "absorb", "inflow", "open"};
+    for (int nPolicy = 0; nPolicy <= WALL_OPEN; ++nPolicy)
+    {
+        if (name != names[nPolicy]) continue;
+        *policy = WallPolicy(nPolicy);
+        return true;
+    }
+    return false;
+}
+
+Protocol::Protocol()
+{
+    this->width = 250;
+    this->budget = 20000;
+    this->logPeriod = 0;
+    this->seed = 1;
+    this->stopped = false;
+    this->nextAction = 0;
+}
+
+bool Protocol::load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::string line;
+    for (int nLine = 1; std::getline(file, line); ++nLine)
+    {
+        std::istringstream words(line.substr(0, line.find('#')));
+        std::string word;
+        if (!(words >> word)) continue;
+
+        bool ok = true;
+        if (word == "box") ok = bool(words >> width) && width > 0;
+        else if (word == "budget") ok = bool(words >> budget) && budget >= 0;
+        else if (word == "seed") ok = bool(words >> seed);
+        else if (word == "log") ok = bool(words >> logPeriod) && logPeriod >= 0;
+        else if (word == "stop")
+        {
+            StopCondition stop;
+            ok = words >> stop.observable >> stop.op >> stop.threshold &&
+                 std::count(std::begin(observables), std::end(observables), stop.observable) &&
+                 (stop.op == "<" || stop.op == "<=" || stop.op == ">" || stop.op == ">=");
+            stops.push_back(stop);
+        }
+        else if (word == "at")
+        {
+            Action action;
+            std::string kind;
+            action.duration = 0;
+            ok = words >> action.tick >> kind && action.tick >= 0;
+
+            if (!ok);
+            else if (kind == "temp") action.kind = ACT_TEMP, ok = bool(words >> action.value);
+            else if (kind == "heat") action.kind = ACT_HEAT, ok = bool(words >> action.value);
+            else if (kind == "ramp") action.kind = ACT_RAMP, ok = words >> action.value >> action.duration && action.duration > 0;
+            else if (kind == "wall") action.kind = ACT_WALL, ok = bool(words >> action.value);
+            else if (kind == "mols") action.kind = ACT_MOLS, ok = bool(words >> action.value);
+            else if (kind == "inflow") action.kind = ACT_INFLOW, ok = words >> action.value && action.value >= 0;
+            else if (kind == "walls")
+            {
+                action.kind = ACT_WALLS;
+                for (int side = 0; side < nWallSides && ok; ++side)
+                    ok = words >> word && parsePolicy(word, &action.walls.policy[side]);
+                ok = ok && selectWallKernel(action.walls);
+            }
+            else ok = false;
+            actions.push_back(action);
+        }
+        else ok = false;
+
+        std::string rest;
+        if (!ok || words >> rest)
+        {
+            error = path + ":" + std::to_string(nLine) + ": cannot parse \"" + line + "\"";
+            return false;
+        }
+    }
+
+    std::stable_sort(actions.begin(), actions.end(), [](const Action& a, const Action& b) { return a.tick < b.tick; });
+    return true;
+}
+
+bool Protocol::hasStops() const
+{
+    return !stops.empty();
+}
+
+double Protocol::observe(Reactor& reactor, const std::string& observable)
+{
+    if (observable == "tick") return reactor.tickCount;
+    if (observable == "temp") return reactor.lftTemp;
+    if (observable == "impulse") return reactor.rgtImpulse;
+    if (observable == "heat") return reactor.lftHeat;
+    if (observable == "outflow") return reactor.outflow;
+    if (observable == "energy") return reactor.energy();
+
+    std::vector<double> cnt = reactor.molCnt();
+    if (observable == "round") return cnt[0];
+    if (observable == "square") return cnt[1];
+    if (observable == "mols") return cnt[0] + cnt[1];
+    return cnt[0] + cnt[1] > 0 ? reactor.energy() / (cnt[0] + cnt[1]) : 0;
+}
+
+void Protocol::apply(Reactor& reactor)
+{
+    long long tick = reactor.tickCount;
+    if (tick == 0 && logPeriod) printf("tick,energy,round,square,temp,impulse,heat,outflow\n");
+
+    for (; nextAction < actions.size() && actions[nextAction].tick <= tick; ++nextAction)
+    {
+        const Action& action = actions[nextAction];
+        switch (action.kind)
+        {
+        case ACT_TEMP: reactor.lftTemp = action.value; break;
+        case ACT_HEAT: reactor.increaseTemp(action.value); break;
+        case ACT_RAMP: ramps.push_back({tick, reactor.lftTemp, action.value, action.duration}); break;
+        case ACT_WALL: reactor.moveWall(int(action.value)); break;
+        case ACT_MOLS: reactor.addRandomMols(int(action.value)); break;
+        case ACT_WALLS: reactor.setWalls(action.walls); break;
+        case ACT_INFLOW: reactor.inflowDensity = action.value; break;
+        }
+    }
+
+    // set from the start value every tick, so long ramps do not accumulate rounding
+    for (const Ramp& ramp: ramps)
+        reactor.lftTemp = ramp.from + (ramp.to - ramp.from) * std::min((tick - ramp.startTick) / ramp.duration, 1.0);
+    ramps.erase(std::remove_if(ramps.begin(), ramps.end(), [tick](const Ramp& ramp)
+    {
+        return tick >= ramp.startTick + ramp.duration;
+    }), ramps.end());
+}
+
+void Protocol::check(Reactor& reactor)
+{
+    if (stopped) return;
+    if (logPeriod && reactor.tickCount % logPeriod == 0) log(reactor);
+
+    for (const StopCondition& stop: stops)
+    {
+        double value = observe(reactor, stop.observable);
+        bool hit = stop.op == "<" ? value < stop.threshold : stop.op == "<=" ? value <= stop.threshold :
+                   stop.op == ">" ? value > stop.threshold : value >= stop.threshold;
+        if (!hit) continue;
+
+        stopped = true;
+        stopReason = stop.observable + " " + stop.op + " " + std::to_string(stop.threshold);
+        if (logPeriod && reactor.tickCount % logPeriod) log(reactor);
+        return;
+    }
+}
+
+void Protocol::log(Reactor& reactor)
+{
+    std::vector<double> cnt = reactor.molCnt();
+    printf("%lld,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g\n", reactor.tickCount, reactor.energy(), cnt[0], cnt[1],
+           reactor.lftTemp, reactor.rgtImpulse, reactor.lftHeat, reactor.outflow);
+    fflush(stdout);
+}
+
+int runProtocol(int argc, char** argv, const std::string& path)
+{
+    Protocol protocol;
+    if (!protocol.load(path))
+    {
+        fprintf(stderr, "%s\n", protocol.error.c_str());
+        return 1;
+    }
+    if (!protocol.hasStops())
+    {
+        fprintf(stderr, "%s: a headless run needs at least one stop condition\n", path.c_str());
+        return 1;
+    }
+
+    // the window builds its reactor the same way, the event loop is never started so its timer stays idle
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    srand(protocol.seed);
+    Reactor reactor(protocol.width);
+    reactor.molBudget = protocol.budget;
+    reactor.protocol = &protocol;
+
+    while (!protocol.stopped)
+        reactor.step();
+
+    fprintf(stderr, "stopped at tick %lld: %s\n", reactor.tickCount, protocol.stopReason.c_str());
+    return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "wallkernel.h"
+
+#include <string>
+#include <vector>
+
+class Reactor;
+
+// Scheduled experiment. A protocol file holds one directive per line, '#' starts a comment:
+//
+//   box 250             half-width of the reactor (default 250, as in the window)
+//   budget 20000        Reactor::molBudget (default 20000, as in the window)
+//   seed 1              srand() seed the reactor is built with (default 1)
+//   log 100             print the observables every 100 ticks
+//   at 0 temp 1         set lftTemp
+//   at 50 heat 0.5      increaseTemp(0.5)
+//   at 100 ramp 5 200   take lftTemp linearly to 5 over the next 200 ticks
+//   at 500 wall -10     moveWall(-10)
+//   at 600 mols 50      addRandomMols(50), negative counts remove molecules
+//   at 700 walls thermostat absorb periodic periodic   setWalls, left right top bottom
+//   at 700 inflow 0.001 inflowDensity
+//   stop energy > 1e5   stop once an observable crosses a threshold (<, <=, >, >=)
+//
+// Observables: tick, energy, round, square, mols, kt (energy per molecule), temp, impulse, heat, outflow.
+// Actions at tick t run at the start of that tick, inside Reactor::step, in file order.
+// Stop conditions are checked after every tick.
+class Protocol
+{
+public:
+    Protocol();
+    bool load(const std::string& path); // false with `error` set when the file is unreadable or malformed
+
+    void apply(Reactor& reactor);       // actions due at reactor.tickCount
+    void check(Reactor& reactor);       // stop conditions and logging after a tick
+    bool hasStops() const;
+
+    int width, budget, logPeriod;
+    unsigned seed;
+    bool stopped;
+    std::string error, stopReason;
+
+private:
+    enum ActionKind { ACT_TEMP, ACT_HEAT, ACT_RAMP, ACT_WALL, ACT_MOLS, ACT_WALLS, ACT_INFLOW };
+
+    class Action
+    {
+    public:
+        long long tick;
+        ActionKind kind;
+        double value, duration;
+        WallConfig walls;
+    };
+
+    class StopCondition
+    {
+    public:
+        std::string observable, op;
+        double threshold;
+    };
+
+    class Ramp
+    {
+    public:
+        long long startTick;
+        double from, to, duration;
+    };
+
+    double observe(Reactor& reactor, const std::string& observable);
+    void log(Reactor& reactor);
+
+    std::vector<Action> actions;
+    std::vector<StopCondition> stops;
+    std::vector<Ramp> ramps;
+    size_t nextAction;
+};
+
+// Runs a protocol without a window, as fast as the simulation goes, and prints its log
+int runProtocol(int argc, char** argv, const std::string& path);
+
+#endif // PROTOCOL_H
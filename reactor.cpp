@@ -1,17 +1,32 @@
 #include "reactor.h"
+#include "snapshot.h"
+#include "protocol.h"
 
 #include <QPainter>
 #include <QTimer>
 
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <limits>
+
 const double Pi = 3.1415926;
 
 const double dt = 1, explodeDT = 0.3, unitRadius = 5, spawnV = 5;
 const int spawnM = 1, nSpawn = 100, fps = 60;
 
-const int buttonSize = 50, buttonGap = 10;
+const int maxCoarseParts = 4;
+const double refineFraction = 0.5, refineGap = 1.15; // ring spacing just over the placement clearance
+const int refineTries = 16;
+
+const double reorderThreshold = 0.8;
+const double screenSlack = 1e-6; // rounding between pos + v * dt and the advanced copy
+const int minReorderMols = 256;
+
+const int buttonSize = 50, buttonGap = 10, wallWidth = 3, minMolMargin = 20;
 const double unpressColorCoeff = 0.7;
 
-QColor squareCol = Qt::red;
+QColor roundCol = Qt::blue, squareCol = Qt::red;
 
 bool isZero(double a)
 {
@@ -49,9 +64,11 @@ void solveQuadratic(double a, double b, double c, double* x1, double* x2, int* n
 Molecule::Molecule(int mass, Vector v, Vector pos, MolType type)
 {
     this->status = MOL_VALID;
+    this->weight = 1;
+    this->born = 0;
 
     this->mass = mass;
-    this->r = unitRadius * std::sqrt(mass);
+    this->r = molRadius(mass);
     this->v = v;
     this->pos = pos;
     this->type = type;
@@ -60,7 +77,18 @@ Molecule::Molecule(int mass, Vector v, Vector pos, MolType type)
 RoundMol::RoundMol(int mass, Vector v, Vector pos) : Molecule(mass, v, pos, MOL_ROUND) {};
 SquareMol::SquareMol(int mass, Vector v, Vector pos) : Molecule(mass, v, pos, MOL_SQUARE) {};
 
-void RoundMol::collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule* other)
+// Fragments an explosion of n unit molecules makes, never more than maxParts (at least 3).
+// Equal parts spread evenly over the circle cancel each other's momentum and keep the fragments' total energy,
+// so n is split evenly when a divisor allows; otherwise into antipodal pairs and one remainder at the centre.
+int fragmentParts(int n, int maxParts)
+{
+    if (n <= maxParts) return n;
+    for (int parts = maxParts; parts >= 2; --parts)
+        if (n % parts == 0) return parts;
+    return (maxParts - 1) / 2 * 2 + 1;
+}
+
+void RoundMol::collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule* other, int maxParts)
 {
     switch (other->type)
     {
@@ -68,39 +96,56 @@ void RoundMol::collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule
         {
             Vector newV = (this->v * this->mass + other->v * other->mass) / (this->mass + other->mass);
             SquareMol* newMol = new SquareMol(this->mass + other->mass, newV, collidePos);
+            newMol->weight = std::min(this->weight, other->weight);
             mols.push_back(newMol);
             break;
         }
         case MOL_SQUARE:
             Vector newV = (this->v * this->mass + other->v * other->mass) / (this->mass + other->mass);
             SquareMol* newMol = new SquareMol(this->mass + other->mass, newV, collidePos);
+            newMol->weight = std::min(this->weight, other->weight);
             mols.push_back(newMol);
             break;
     }
 }
 
-void SquareMol::collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule* other)
+void SquareMol::collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule* other, int maxParts)
 {
     switch (other->type)
     {
         case MOL_ROUND:
         {
-            other->collide(mols, pos, this);
+            other->collide(mols, pos, this, maxParts);
             break;
         }
         case MOL_SQUARE:
         {
             int n = this->mass + other->mass;
-            std::vector<Molecule*> newMols(n);
+            int nParts = fragmentParts(n, maxParts);
+            int nPairs = n % nParts ? nParts / 2 : 0; // uneven split: pairs of equal weight, the rest at the centre
+            int totalWeight = std::min(this->weight, other->weight) * n;
+            int partWeight = std::min(this->weight, other->weight) * (n / nParts);
             double angle0 = randDouble(0, 2 * Pi);
             double vMod = randDouble(1, spawnV);
             Vector vImpulse = (this->v * this->mass + other->v * other->mass) / n;
 
-            for (int i = 0; i < n; ++i)
+            if (nPairs)
             {
-                double angle = angle0 + i * (2 * Pi / n);
+                // the pairs carry the whole relative energy the remainder does not
+                vMod *= std::sqrt(double(totalWeight) / (2 * nPairs * partWeight));
+                RoundMol* rest = new RoundMol(1, vImpulse, collidePos + vImpulse * explodeDT);
+                rest->weight = totalWeight - 2 * nPairs * partWeight;
+                mols.push_back(rest);
+                nParts = 2 * nPairs;
+            }
+
+            for (int i = 0; i < nParts; ++i)
+            {
+                double angle = angle0 + i * (2 * Pi / nParts);
                 Vector newV = Vector(vMod * std::cos(angle), vMod * std::sin(angle), 0) + vImpulse;
-                mols.push_back(new RoundMol(1, newV, collidePos + newV * explodeDT));
+                RoundMol* newMol = new RoundMol(1, newV, collidePos + newV * explodeDT);
+                newMol->weight = partWeight;
+                mols.push_back(newMol);
             }
 
             break;
@@ -110,7 +155,7 @@ void SquareMol::collide(std::vector<Molecule*>& mols, Vector collidePos, Molecul
 
 void RoundMol::draw(QPainter* painter)
 {
-    painter->setBrush(Qt::blue);
+    painter->setBrush(roundCol);
     painter->drawEllipse(QPointF(pos.x, -pos.y), r, r);
 }
 
@@ -121,57 +166,90 @@ void SquareMol::draw(QPainter* painter)
     painter->drawEllipse(QPointF(pos.x, -pos.y), r, r);
 }
 
-Molecule* randMolecule(double spawnP)
+double molRadius(int mass)
+{
+    return unitRadius * std::sqrt(mass);
+}
+
+Molecule* newMolecule(MolType type, int mass, Vector v, Vector pos)
+{
+    if (type == MOL_ROUND) return new RoundMol(mass, v, pos);
+    else return new SquareMol(mass, v, pos);
+}
+
+Molecule* randMolecule(Vector lo, Vector hi)
 {
     Vector v = Vector(randDouble(-spawnV, spawnV), randDouble(-spawnV, spawnV), 0);
-    Vector pos = Vector(randDouble(-spawnP, spawnP), randDouble(-spawnP, spawnP), 0);
+    Vector pos = Vector(randDouble(lo.x, hi.x), randDouble(lo.y, hi.y), 0);
 
     if (rand() % 2) return new RoundMol(1, v, pos);
     else return new SquareMol(randInt(1, spawnM), v, pos);
 }
 
-Button::Button(int xl, int yt, int xr, int yb, Vector color)
+Molecule* randMolecule(double spawnP)
+{
+    return randMolecule(Vector(-spawnP, -spawnP, 0), Vector(spawnP, spawnP, 0));
+}
+
+Button::Button(int xl, int yt, int xr, int yb, Vector color, QGraphicsItem* parent) : QGraphicsObject(parent)
 {
     this->TL = IntVector(xl, yt, 0);
     this->BR = IntVector(xr, yb, 0);
     this->press_color = color;
     this->unpress_color = color * unpressColorCoeff;
     this->is_pressed = 0;
+
+    setAcceptedMouseButtons(Qt::LeftButton);
+    setCacheMode(QGraphicsItem::DeviceCoordinateCache);
 }
 
 void Button::action()
 {
     is_pressed = 1;
+    update();
     emit pressed();
 }
 
 void Button::unpress()
 {
     is_pressed = 0;
+    update();
 }
 
-void Reactor::mousePressEvent(QGraphicsSceneMouseEvent* event)
+QRectF Button::boundingRect() const
 {
-    int xPos = event->pos().x(), yPos = -event->pos().y();
-    for (Button* button: buttons)
-    {
-        if (button->TL.x <= xPos && xPos <= button->BR.x && button->BR.y <= yPos && yPos <= button->TL.y)
-        {
-            button->action();
-            break;
-        }
-    }
+    return QRectF(TL.x - 1, -TL.y - 1, BR.x - TL.x + 2, TL.y - BR.y + 2);
 }
 
-void Reactor::mouseReleaseEvent(QGraphicsSceneMouseEvent* event)
+void Button::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-    for (Button* button: buttons)
-        button->unpress();
+    Vector color;
+    if (is_pressed) color = press_color;
+    else color = unpress_color;
+    color *= 255;
+
+    painter->setPen(QPen(Qt::transparent, 0));
+    painter->setBrush(QColor(color.x, color.y, color.z));
+    painter->drawRect(TL.x, -TL.y, BR.x - TL.x, TL.y - BR.y);
+}
+
+void Button::mousePressEvent(QGraphicsSceneMouseEvent* event)
+{
+    action();
+}
+
+void Button::mouseReleaseEvent(QGraphicsSceneMouseEvent* event)
+{
+    unpress();
 }
 
 void Reactor::moveWall(int step)
 {
+    prepareGeometryChange();
+    wallLayer->prepareChange();
     TL.x -= step;
+    gridFresh = false;
+    wallLayer->refresh();
 }
 
 void Reactor::increaseTemp(double step)
@@ -179,47 +257,99 @@ void Reactor::increaseTemp(double step)
     lftTemp += step;
 }
 
-void Reactor::addRandomMols(int nMols)
+void Reactor::addRandomMols(int nMols, double spawnP)
 {
     if (nMols >= 0)
     {
-        while (nMols--)
-        {
-            mols.push_back(randMolecule(100));
-        }
+        int nPlaced = addMols(nMols, Vector(-spawnP, -spawnP, 0), Vector(spawnP, spawnP, 0), spawnSpec);
+        if (nPlaced < nMols) fprintf(stderr, "only %d of %d molecules fit\n", nPlaced, nMols);
         return;
     }
 
-    nMols *= -1;
-    while (nMols--)
+    // distinct picks among the molecules still alive, so an emptied box just has nothing to remove
+    std::vector<Molecule*> alive;
+    for (Molecule* mol: mols)
+        if (mol->status != MOL_INVALID) alive.push_back(mol);
+
+    nMols = std::min(-nMols, int(alive.size()));
+    for (int nRemoved = 0; nRemoved < nMols; ++nRemoved)
+    {
+        std::swap(alive[nRemoved], alive[nRemoved + rand() % (alive.size() - nRemoved)]);
+        alive[nRemoved]->status = MOL_INVALID;
+    }
+    gridFresh = false;
+}
+
+int Reactor::addMols(int nMols, Vector lo, Vector hi, PopulationSpec spec)
+{
+    // keep the batch inside the walls and away from the molecules already there
+    lo = Vector(std::max(lo.x, double(TL.x)), std::max(lo.y, double(BR.y)), 0);
+    hi = Vector(std::min(hi.x, double(BR.x)), std::min(hi.y, double(TL.y)), 0);
+    spec.seed = rand();
+
+    // only molecules that can touch the region are obstacles: those the last grid indexes are looked up in it,
+    // its cells being at least twice the largest radius wide, the few appended since are tested one by one
+    double newR = molRadius(spec.maxMass), gridReach = grid.cellSize + 2 * newR;
+    std::vector<Molecule*> nearMols;
+    if (gridMols) nearMols = gridMolsInRect(lo - Vector(gridReach, gridReach, 0), hi + Vector(gridReach, gridReach, 0));
+    for (int nMol = gridMols; nMol < int(mols.size()); ++nMol)
     {
-        int randIndex = rand() % mols.size();
-        mols[randIndex]->status = MOL_INVALID;
+        Molecule* mol = mols[nMol];
+        double reach = 2 * (mol->r + newR);
+        if (mol->pos.x > lo.x - reach && mol->pos.x < hi.x + reach && mol->pos.y > lo.y - reach &&
+            mol->pos.y < hi.y + reach)
+            nearMols.push_back(mol);
     }
+
+    std::vector<Molecule*> newMols = generatePopulation(nMols, lo, hi, spec, nearMols);
+    for (Molecule* mol: newMols)
+        mol->born = tickCount;
+    mols.insert(mols.end(), newMols.begin(), newMols.end());
+    gridFresh = false;
+    return newMols.size();
 }
 
 void Reactor::addButton(Vector color)
 {
     int nButton = buttons.size();
     buttons.push_back(new Button(TL.x + (buttonSize + buttonGap) * nButton, TL.y + buttonSize + 10,
-                                 TL.x + (buttonSize) * (nButton + 1) + buttonGap * nButton, TL.y + 10, color));
+                                 TL.x + (buttonSize) * (nButton + 1) + buttonGap * nButton, TL.y + 10, color, this));
 }
 
-Reactor::Reactor(int width)
+Reactor::Reactor(int width) : Reactor(IntVector(-width, width, 0), IntVector(width, -width, 0))
+{
+    mols.reserve(nSpawn * 3);
+    int nPlaced = addMols(nSpawn, Vector(-width * 0.8, -width * 0.8, 0), Vector(width * 0.8, width * 0.8, 0), spawnSpec);
+    if (nPlaced < nSpawn) fprintf(stderr, "only %d of %d molecules fit\n", nPlaced, nSpawn);
+}
+
+Reactor::Reactor(IntVector TL, IntVector BR)
 {
     #define BUTTON_ACTION(function)\
     QObject::connect(buttons[buttons.size() - 1], &Button::pressed, this, [this]{ function; });
 
-    setAcceptedMouseButtons(Qt::LeftButton);
+    this->TL = TL;
+    this->BR = BR;
+    this->margin = minMolMargin;
 
-    // this->width = this->height = width;
-    this->TL = IntVector(-width, width, 0);
-    this->BR = IntVector(width, -width, 0);
+    // walls change only on moveWall, the molecules above them repaint every tick
+    wallLayer = new CachedLayer(this, [this]
+    {
+        return QRectF(this->TL.x - wallWidth, -this->TL.y - wallWidth, this->BR.x - this->TL.x + 2 * wallWidth,
+                      this->TL.y - this->BR.y + 2 * wallWidth);
+    }, [this](QPainter* painter)
+    {
+        painter->setPen(QPen(Qt::black, wallWidth));
+        painter->setBrush(Qt::transparent);
+        painter->drawRect(this->TL.x, -this->TL.y, this->BR.x - this->TL.x, this->TL.y - this->BR.y);
+    });
+    setWalls(WallConfig());
+    std::fill(inflowDebt, inflowDebt + nWallSides, 0);
+    gridFresh = false;
+    gridMols = 0;
+    setAcceptedMouseButtons(Qt::LeftButton);
 
     mols = std::vector<Molecule*>();
-    mols.reserve(nSpawn * 3);
-    for (int nMol = 0; nMol < nSpawn; ++nMol)
-        mols.push_back(randMolecule(width * 0.8));
 
     timer = new QTimer();
     timer->setInterval(1000.0 / fps);
@@ -243,6 +373,17 @@ Reactor::Reactor(int width)
     BUTTON_ACTION(addRandomMols(-10))
 
     this->lftTemp = 1;
+    this->rgtImpulse = this->lftHeat = 0;
+    this->tickCount = 0;
+    this->molBudget = 0;
+    this->fieldPeriod = 0;
+    this->inflowDensity = 0;
+    this->outflow = 0;
+    this->protocol = nullptr;
+    this->sortedLocality = 1;
+    this->reorderEnabled = true;
+    this->spawnSpec.temperature = spawnV * spawnV / 3;
+    this->spawnSpec.maxMass = spawnM;
     d = new QLabel();
     #undef BUTTON_ACTION
 }
@@ -256,50 +397,148 @@ Reactor::~Reactor()
     delete timer;
 }
 
+// only the molecule layer, walls and buttons are separate cached items
 QRectF Reactor::boundingRect() const
 {
-    // return QRectF(-width - 5, -height * 2 - 5, 2 * (width + 5), 3 * (height + 5));
-    return QRect(TL.x - 5 - 300, -(TL.y + 5) - 100, BR.x - TL.x + 10 + 300, TL.y - BR.y + 10 + 100);
+    return QRectF(TL.x - margin, -TL.y - margin, BR.x - TL.x + 2 * margin, TL.y - BR.y + 2 * margin);
+}
+
+// Products grow past any fixed margin, and a molecule touching a wall must still be inside the bounding rect
+void Reactor::fitMargin()
+{
+    int maxR = 0;
+    for (Molecule* mol: mols)
+        maxR = std::max(maxR, mol->r);
+    if (maxR + 1 <= margin) return;
+
+    prepareGeometryChange();
+    margin = maxR + 1;
 }
 
+// Scalar reference for the default wall kernel: advances the molecule and reflects it off every wall it crossed
 void Reactor::checkWallCollision(Molecule* mol)
 {
     Vector newPos = mol->pos + mol->v * dt;
+    double vx0 = mol->v.x;
+    mol->status = MOL_VALID;
 
-    if (newPos.x > BR.x)
+    if (newPos.x > BR.x && !isOpen(WALL_RGT))
     {
-        rgtImpulse += mol->mass * mol->v.x;
-        mol->pos = Vector(2 * BR.x - newPos.x, newPos.y, 0);
+        rgtImpulse += mol->weight * mol->mass * vx0;
+        newPos.x = 2 * BR.x - newPos.x;
         mol->v.x *= -1;
+        mol->status = MOL_WALL_BOUNCE;
     }
-    else if (newPos.x < TL.x)
+    else if (newPos.x < TL.x && !isOpen(WALL_LFT))
     {
-        mol->pos = Vector(2 * TL.x - newPos.x, newPos.y, 0);
+        newPos.x = 2 * TL.x - newPos.x;
         mol->v.x *= -1;
         mol->v.x += lftTemp / mol->mass;
+        lftHeat += mol->weight * mol->mass * (mol->v.x * mol->v.x - vx0 * vx0) / 2;
+        mol->status = MOL_WALL_BOUNCE;
     }
-    else if (newPos.y > TL.y)
+
+    if (newPos.y > TL.y)
     {
-        mol->pos = Vector(newPos.x, 2 * TL.y - newPos.y, 0);
+        newPos.y = 2 * TL.y - newPos.y;
         mol->v.y *= -1;
+        mol->status = MOL_WALL_BOUNCE;
     }
     else if (newPos.y < BR.y)
     {
-        mol->pos = Vector(newPos.x, 2 * BR.y - newPos.y, 0);
+        newPos.y = 2 * BR.y - newPos.y;
         mol->v.y *= -1;
+        mol->status = MOL_WALL_BOUNCE;
     }
-    else
+
+    mol->pos = newPos;
+}
+
+// Switches to the kernel of another wall combination, keeps the current one if that combination is not compiled in
+bool Reactor::setWalls(WallConfig config)
+{
+    WallKernel kernel = selectWallKernel(config);
+    if (!kernel) return false;
+
+    walls = config;
+    wallKernel = kernel;
+    gridFresh = false;
+    return true;
+}
+
+bool Reactor::isOpen(WallSide side) const
+{
+    return walls.policy[side] == WALL_OPEN;
+}
+
+void Reactor::reflectWalls(MolArrays& arrays)
+{
+    double bounds[nWallSides] = {double(TL.x), double(BR.x), double(TL.y), double(BR.y)};
+
+    WallSums sums = wallKernel(arrays, dt, bounds, lftTemp);
+    rgtImpulse += sums.impulse[WALL_RGT];
+    lftHeat += sums.heat[WALL_LFT];
+    for (int side = 0; side < nWallSides; ++side)
+        outflow += sums.absorbed[side];
+}
+
+void Reactor::injectInflow()
+{
+    // unit-mass reservoir molecules cross a line at n sqrt(kT / 2 pi m) per unit length (2D Maxwell-Boltzmann)
+    double kT = spawnSpec.temperature;
+    for (int side = 0; side < nWallSides; ++side)
     {
-        mol->status = MOL_VALID;
-        return;
+        if (walls.policy[side] != WALL_INFLOW) continue;
+
+        bool vertical = side == WALL_LFT || side == WALL_RGT;
+        double dir = side == WALL_RGT || side == WALL_TOP ? 1 : -1;
+        double bound = side == WALL_LFT ? TL.x : side == WALL_RGT ? BR.x : side == WALL_TOP ? TL.y : BR.y;
+        double lo = vertical ? BR.y : TL.x, hi = vertical ? TL.y : BR.x;
+
+        inflowDebt[side] += inflowDensity * std::sqrt(kT / (2 * Pi)) * (hi - lo) * dt;
+        for (; inflowDebt[side] >= 1; inflowDebt[side] -= 1)
+        {
+            // flux-weighted normal speed, Maxwellian along the wall, entered at a random moment of the tick
+            double vn = std::sqrt(-2 * kT * std::log(randDouble(1e-12, 1)));
+            double vt = std::sqrt(-2 * kT * std::log(randDouble(1e-12, 1))) * std::cos(randDouble(0, 2 * Pi));
+            double n = bound - dir * vn * randDouble(0, dt), t = randDouble(lo, hi);
+
+            Vector v = vertical ? Vector(-dir * vn, vt, 0) : Vector(vt, -dir * vn, 0);
+            Vector pos = vertical ? Vector(n, t, 0) : Vector(t, n, 0);
+            Molecule* mol = newMolecule(rand() % 2 ? MOL_ROUND : MOL_SQUARE, 1, v, pos);
+            mol->born = tickCount + 1;
+            mols.push_back(mol);
+        }
     }
+}
 
-    mol->status = MOL_WALL_BOUNCE;
+void Reactor::buildGrid(double minCellSize)
+{
+    grid.build(molArrays, TL, BR, minCellSize, walls.policy[WALL_LFT] == WALL_PERIODIC,
+               walls.policy[WALL_TOP] == WALL_PERIODIC);
+}
+
+// Makes grid and molArrays describe the current mols, the state the next step starts from
+void Reactor::refreshGrid()
+{
+    buildGrid(collisionReach());
+    gridFresh = true;
+    gridMols = mols.size();
+}
+
+// The periodic copy of pos closest to from (minimum image), pos itself along walled axes
+Vector Reactor::nearestImage(Vector pos, Vector from) const
+{
+    double width = BR.x - TL.x, height = TL.y - BR.y;
+    if (walls.policy[WALL_LFT] == WALL_PERIODIC) pos.x -= width * std::round((pos.x - from.x) / width);
+    if (walls.policy[WALL_TOP] == WALL_PERIODIC) pos.y -= height * std::round((pos.y - from.y) / height);
+    return pos;
 }
 
 void Reactor::checkMolCollision(Molecule* mol, Molecule* mol2)
 {
-    Vector V = mol->v - mol2->v, P = mol->pos - mol2->pos;
+    Vector pos2 = nearestImage(mol2->pos, mol->pos);
+    Vector V = mol->v - mol2->v, P = mol->pos - pos2;
     double R = mol->r + mol2->r, t1 = 0, t2 = 0;
     int nRoots = 0;
 
@@ -308,67 +547,240 @@ void Reactor::checkMolCollision(Molecule* mol, Molecule* mol2)
     if (nRoots != 2 || t1 < 0 || t1 > dt) return;
 
     mol->status = mol2->status = MOL_INVALID;
-    Vector critPos1 = mol->pos + mol->v * t1, critPos2 = mol2->pos + mol2->v * t1;
+    Vector critPos1 = mol->pos + mol->v * t1, critPos2 = pos2 + mol2->v * t1;
     Vector collidePos = (critPos1 * mol2->r + critPos2 * mol->r) / (mol->r + mol2->r);
-    mol->collide(mols, collidePos, mol2);
+    collidePos = nearestImage(collidePos, Vector((TL.x + BR.x) / 2.0, (TL.y + BR.y) / 2.0, 0));
+    bool coarse = molBudget && int(mols.size()) > molBudget;
+    mol->collide(mols, collidePos, mol2, coarse ? maxCoarseParts : INT_MAX);
+
+    // super-particles react copy by copy, the unmatched copies of the heavier one fly on
+    int nPairs = std::min(mol->weight, mol2->weight);
+    for (Molecule* reactant: {mol, mol2})
+    {
+        if (reactant->weight == nPairs) continue;
+        reactant->weight -= nPairs;
+        reactant->status = MOL_VALID;
+    }
+}
+
+void Reactor::refineMols(int limit)
+{
+    // choose first, so molecules that stay coarse are obstacles for every copy
+    int nMols = mols.size(), nAfter = nMols;
+    std::vector<char> split(nMols, 0);
+    std::vector<Molecule*> kept;
+    double maxR = 0;
+    for (int nMol = 0; nMol < nMols; ++nMol)
+    {
+        Molecule* mol = mols[nMol];
+        split[nMol] = mol->weight > 1 && nAfter + mol->weight - 1 <= limit;
+        if (!split[nMol])
+        {
+            kept.push_back(mol);
+            continue;
+        }
+        nAfter += mol->weight - 1;
+        maxR = std::max(maxR, double(mol->r));
+    }
+    if (nAfter == nMols) return;
+
+    Obstacles obstacles(kept, Vector(TL.x, BR.y, 0), Vector(BR.x, TL.y, 0), maxR);
+    for (int nMol = 0; nMol < nMols; ++nMol)
+        if (split[nMol]) obstacles.add(mols[nMol]->pos.x, mols[nMol]->pos.y, mols[nMol]->r);
+
+    for (int nMol = 0; nMol < nMols; ++nMol)
+    {
+        if (!split[nMol]) continue;
+        Molecule* mol = mols[nMol];
+        double r = mol->r;
+
+        // a free spot inside the walls, on the ring first and then anywhere a little further out
+        auto place = [&](Vector pos)
+        {
+            if (BR.x - TL.x < 2 * r || TL.y - BR.y < 2 * r) return false;
+            pos.x = std::clamp(pos.x, TL.x + r, BR.x - r);
+            pos.y = std::clamp(pos.y, BR.y + r, TL.y - r);
+            if (obstacles.blocked(pos.x, pos.y, r)) return false;
+
+            obstacles.add(pos.x, pos.y, r);
+            mols.push_back(newMolecule(mol->type, mol->mass, mol->v, pos));
+            mols.back()->born = mol->born;
+            return true;
+        };
+
+        // copies share the velocity, so energy and momentum stay put; the original keeps its spot,
+        // the copies ring it, and copies that find no room stay merged into it
+        int nRing = mol->weight - 1, nUnplaced = 0;
+        double ringR = refineGap * std::max(2 * r, r / std::sin(Pi / std::max(nRing, 2)));
+        for (int nCopy = 0; nCopy < nRing; ++nCopy)
+        {
+            double angle = nCopy * (2 * Pi / nRing);
+            bool placed = place(mol->pos + Vector(std::cos(angle), std::sin(angle), 0) * ringR);
+            for (int nTry = 0; !placed && nTry < refineTries; ++nTry)
+            {
+                angle = randDouble(0, 2 * Pi);
+                placed = place(mol->pos + Vector(std::cos(angle), std::sin(angle), 0) * ringR * randDouble(1, 3));
+            }
+            nUnplaced += !placed;
+        }
+        mol->weight = 1 + nUnplaced;
+    }
+}
+
+// Candidates are screened on molArrays, laid out like mols and already advanced by this tick's free flight.
+// Only molecules the walls left alone can react, and those are at pos + v * dt: a pair that ends up further
+// apart than R + |V| dt never met. The molecules themselves are read just for the pairs that pass, and
+// molArrays.weight follows their reactions, 0 once used up.
+void Reactor::findMolCollision(int nMol)
+{
+    Molecule* mol = mols[nMol];
+    Vector end = Vector(molArrays.x[nMol], molArrays.y[nMol], 0);
+    double vx = molArrays.vx[nMol], vy = molArrays.vy[nMol], r = molArrays.r[nMol];
+    grid.visitNear(grid.molCell[nMol], [&](int nMol2)
+    {
+        if (nMol2 == nMol || !molArrays.weight[nMol2] || molArrays.bounce[nMol2]) return true;
+
+        Vector P = nearestImage(Vector(molArrays.x[nMol2], molArrays.y[nMol2], 0), end) - end;
+        double Vx = molArrays.vx[nMol2] - vx, Vy = molArrays.vy[nMol2] - vy;
+        double reach = r + molArrays.r[nMol2] + std::sqrt(Vx * Vx + Vy * Vy) * dt + screenSlack;
+        if (P.x * P.x + P.y * P.y > reach * reach) return true;
+
+        Molecule* mol2 = mols[nMol2];
+        checkMolCollision(mol, mol2);
+        molArrays.weight[nMol] = mol->status == MOL_INVALID ? 0 : mol->weight;
+        molArrays.weight[nMol2] = mol2->status == MOL_INVALID ? 0 : mol2->weight;
+        return mol->status != MOL_INVALID;
+    });
+}
+
+// also leaves the current state gathered in molArrays
+double Reactor::collisionReach()
+{
+    molArrays.gather(mols);
+    return molArrays.collisionReach(dt);
+}
+
+void Reactor::reorderMols()
+{
+    double reach = collisionReach();
+    buildGrid(reach);
+
+    int nMols = mols.size();
+    std::vector<std::pair<uint64_t, int>> keys(nMols);
+    for (int nMol = 0; nMol < nMols; ++nMol)
+        keys[nMol] = {grid.mortonCode(grid.molCell[nMol]), nMol};
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<Molecule*> sortedMols(nMols);
+    for (int nMol = 0; nMol < nMols; ++nMol)
+        sortedMols[nMol] = mols[keys[nMol].second];
+    mols.swap(sortedMols);
+
+    molArrays.gather(mols);
+    buildGrid(grid.cellSize);
+    sortedLocality = grid.locality;
 }
 
 void clearInvalidMols(std::vector<Molecule*>& mols)
 {
-    for (std::vector<Molecule*>::iterator molIter = mols.begin(); molIter != mols.end(); molIter++)
+    int nValid = 0;
+    for (Molecule* mol: mols)
     {
-        switch ((*molIter)->status)
+        switch (mol->status)
         {
         case MOL_VALID:
             break;
         case MOL_INVALID:
-            delete *molIter;
-            mols.erase(molIter);
-            --molIter;
-            break;
+            delete mol;
+            continue;
         case MOL_WALL_BOUNCE:
-            (*molIter)->status = MOL_VALID;
+            mol->status = MOL_VALID;
             break;
         }
+        mols[nValid++] = mol;
     }
+    mols.resize(nValid);
 }
 
 void Reactor::advance()
 {
-    std::vector<Molecule*>::iterator molsEnd = mols.end();
-    for (std::vector<Molecule*>::iterator molIter = mols.begin(); molIter != molsEnd; molIter++)
-    {
-        Molecule* mol = *molIter;
-        if (mol->status != MOL_VALID) continue;
-
-        checkWallCollision(mol);
-        if (mol->status == MOL_WALL_BOUNCE) continue;
+    step();
+    fitMargin();
+    update();
 
-        for (std::vector<Molecule*>::iterator molIter2 = mols.begin(); molIter2 != molsEnd; molIter2++)
-        {
-            if (molIter == molIter2) continue;
-            Molecule* mol2 = *molIter2;
-            if (mol2->status != MOL_VALID) continue;
+    emit energySig({energy()});
+    emit molCntSig(molCnt());
+    if (fields.tick == tickCount - 1) emit fieldsSig(fields);
+    emit stepped();
 
-            checkMolCollision(mol, mol2);
-            if (mol->status == MOL_INVALID) break;
-        }
+    if (protocol && protocol->stopped)
+    {
+        timer->stop();
+        emit protocolStopped(QString::fromStdString(protocol->stopReason));
+    }
+}
 
-        if (mol->status == MOL_VALID) mol->pos = mol->pos + mol->v * dt;;
+void Reactor::step()
+{
+    if (protocol) protocol->apply(*this);
+
+    // the grid left by the previous tick serves queries in between and is reused unless something changed
+    if (!gridFresh) refreshGrid();
+    gridFresh = false;
+    gridMols = 0;
+    if (reorderEnabled && int(mols.size()) >= minReorderMols && grid.locality < reorderThreshold * sortedLocality)
+        reorderMols();
+    if (fieldPeriod > 0 && tickCount % fieldPeriod == 0)
+        fields.bin(molArrays, TL, BR, tickCount);
+
+    // walls and free flight for everyone at once, reactions below still see start-of-tick positions
+    int nMols = mols.size();
+    countProbes();
+    reflectWalls(molArrays);
+    for (int nMol = 0; nMol < nMols; ++nMol)
+    {
+        if (molArrays.bounce[nMol] & BOUNCE_ABSORBED) mols[nMol]->status = MOL_INVALID;
+        else if (molArrays.bounce[nMol] && mols[nMol]->status == MOL_VALID) mols[nMol]->status = MOL_WALL_BOUNCE;
     }
 
+    // products of this tick's reactions are appended past nMols and only move from the next tick on
+    for (int nMol = 0; nMol < nMols; ++nMol)
+        if (molArrays.weight[nMol] && !molArrays.bounce[nMol]) findMolCollision(nMol);
+
+    for (int nMol = nMols; nMol < int(mols.size()); ++nMol)
+        mols[nMol]->born = tickCount + 1;
+
+    molArrays.scatter(mols);
     clearInvalidMols(mols);
-    update();
+    injectInflow();
+    if (molBudget && int(mols.size()) < molBudget * refineFraction) refineMols(molBudget * refineFraction);
+    ++tickCount;
+    refreshGrid();
 
-    emit energySig({energy()});
-    emit molCntSig(molCnt());
+    if (protocol) protocol->check(*this);
+}
+
+QByteArray Reactor::snapshotFrame()
+{
+    std::vector<double> cnt = molCnt();
+
+    SnapshotHeader header = SnapshotHeader();
+    header.tick = tickCount;
+    header.tlX = TL.x;
+    header.tlY = TL.y;
+    header.brX = BR.x;
+    header.brY = BR.y;
+    header.energy = energy();
+    header.round = cnt[0];
+    header.square = cnt[1];
+    header.lftTemp = lftTemp;
+    header.rgtImpulse = rgtImpulse;
+    header.lftHeat = lftHeat;
+    return encodeSnapshot(header, mols);
 }
 
 void Reactor::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-    painter->setPen(QPen(Qt::black, 3));
-    painter->setBrush(Qt::transparent);
-    painter->drawRect(TL.x, -TL.y, BR.x - TL.x, TL.y - BR.y);
     painter->setPen(QPen(Qt::transparent, 0));
 
     for (std::vector<Molecule*>::iterator molIter = mols.begin(); molIter != mols.end(); molIter++)
@@ -376,24 +788,13 @@ void Reactor::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, Q
         Molecule* mol = *molIter;
         mol->draw(painter);
     }
-
-    for (Button* button: buttons)
-    {
-        Vector color;
-        if (button->is_pressed) color = button->press_color;
-        else color = button->unpress_color;
-        color *= 255;
-
-        painter->setBrush(QColor(color.x, color.y, color.z));
-        painter->drawRect(button->TL.x, -button->TL.y, button->BR.x - button->TL.x, button->TL.y - button->BR.y);
-    }
 }
 
 double Reactor::energy()
 {
     double ans = 0;
     for (Molecule* mol: mols)
-        ans += mol->mass * std::pow(*(mol->v), 2) / 2;
+        ans += mol->weight * mol->mass * std::pow(*(mol->v), 2) / 2;
     return ans;
 }
 
@@ -402,8 +803,181 @@ std::vector<double> Reactor::molCnt()
     int round = 0, square = 0;
     for (Molecule* mol: mols)
     {
-        if (mol->type == MOL_ROUND) ++round;
-        else ++square;
+        if (mol->type == MOL_ROUND) round += mol->weight;
+        else square += mol->weight;
     }
     return {double(round), double(square)};
 }
+
+LineProbe::LineProbe(Vector p1, Vector p2)
+{
+    this->p1 = p1;
+    this->p2 = p2;
+    this->forward = this->backward = 0;
+}
+
+int Reactor::addProbe(Vector p1, Vector p2)
+{
+    probes.push_back(LineProbe(p1, p2));
+    return probes.size() - 1;
+}
+
+// Runs on start-of-tick molArrays: nobody moves further than a cell per tick, so crossers start near the probe
+void Reactor::countProbes()
+{
+    for (LineProbe& probe: probes)
+    {
+        Vector d = probe.p2 - probe.p1;
+        int cxl = std::max(grid.cellX(std::min(probe.p1.x, probe.p2.x)) - 1, 0);
+        int cxr = std::min(grid.cellX(std::max(probe.p1.x, probe.p2.x)) + 1, grid.nx - 1);
+        int cyl = std::max(grid.cellY(std::min(probe.p1.y, probe.p2.y)) - 1, 0);
+        int cyr = std::min(grid.cellY(std::max(probe.p1.y, probe.p2.y)) + 1, grid.ny - 1);
+
+        for (int cy = cyl; cy <= cyr; ++cy)
+            for (int cx = cxl; cx <= cxr; ++cx)
+            {
+                int cell = cy * grid.nx + cx;
+                for (int nEntry = grid.cellStart[cell]; nEntry < grid.cellStart[cell + 1]; ++nEntry)
+                {
+                    int nMol = grid.cellMols[nEntry];
+                    double x0 = molArrays.x[nMol], y0 = molArrays.y[nMol];
+                    double mx = molArrays.vx[nMol] * dt, my = molArrays.vy[nMol] * dt;
+
+                    // the path changes side of the probe line, and the probe ends lie on either side of the path
+                    double side0 = d.x * (y0 - probe.p1.y) - d.y * (x0 - probe.p1.x);
+                    double side1 = d.x * (y0 + my - probe.p1.y) - d.y * (x0 + mx - probe.p1.x);
+                    if ((side0 > 0) == (side1 > 0)) continue;
+                    double end1 = mx * (probe.p1.y - y0) - my * (probe.p1.x - x0);
+                    double end2 = mx * (probe.p2.y - y0) - my * (probe.p2.x - x0);
+                    if ((end1 > 0) == (end2 > 0)) continue;
+
+                    if (side0 > 0) probe.forward += molArrays.weight[nMol];
+                    else probe.backward += molArrays.weight[nMol];
+                }
+            }
+    }
+}
+
+std::vector<Molecule*> Reactor::molsInRect(Vector lo, Vector hi)
+{
+    if (!gridFresh) refreshGrid();
+    return gridMolsInRect(lo, hi);
+}
+
+std::vector<Molecule*> Reactor::gridMolsInRect(Vector lo, Vector hi)
+{
+    std::vector<Molecule*> found;
+    for (int cy = grid.cellY(lo.y); cy <= grid.cellY(hi.y); ++cy)
+        for (int cx = grid.cellX(lo.x); cx <= grid.cellX(hi.x); ++cx)
+        {
+            int cell = cy * grid.nx + cx;
+            for (int nEntry = grid.cellStart[cell]; nEntry < grid.cellStart[cell + 1]; ++nEntry)
+            {
+                int nMol = grid.cellMols[nEntry];
+                double x = molArrays.x[nMol], y = molArrays.y[nMol];
+                if (molArrays.weight[nMol] && x >= lo.x && x <= hi.x && y >= lo.y && y <= hi.y)
+                    found.push_back(mols[nMol]);
+            }
+        }
+    return found;
+}
+
+std::vector<Molecule*> Reactor::molsInCircle(Vector centre, double radius)
+{
+    std::vector<Molecule*> found = molsInRect(centre - Vector(radius, radius, 0), centre + Vector(radius, radius, 0));
+    found.erase(std::remove_if(found.begin(), found.end(), [&](Molecule* mol)
+    {
+        Vector delta = mol->pos - centre;
+        return delta.x * delta.x + delta.y * delta.y > radius * radius;
+    }), found.end());
+    return found;
+}
+
+// Visits rings of cells around pos until none of the k best so far can be beaten by a farther ring
+std::vector<Molecule*> Reactor::nearestMols(Vector pos, int k)
+{
+    if (!gridFresh) refreshGrid();
+    if (k <= 0) return {};
+
+    std::vector<std::pair<double, int>> best; // max-heap on squared distance
+    int cx = grid.cellX(pos.x), cy = grid.cellY(pos.y);
+    double cell = std::min(grid.cellW, grid.cellH);
+    for (int ring = 0; ring <= std::max(grid.nx, grid.ny); ++ring)
+    {
+        // every cell of this ring is at least ring - 1 whole cells away from pos
+        double nearest = std::max(ring - 1, 0) * cell;
+        if (int(best.size()) == k && best.front().first <= nearest * nearest) break;
+
+        for (int y = std::max(cy - ring, 0); y <= std::min(cy + ring, grid.ny - 1); ++y)
+        {
+            bool edgeRow = y == cy - ring || y == cy + ring;
+            for (int x = std::max(cx - ring, 0); x <= std::min(cx + ring, grid.nx - 1); ++x)
+            {
+                if (!edgeRow && x != cx - ring && x != cx + ring) continue;
+
+                int near = y * grid.nx + x;
+                for (int nEntry = grid.cellStart[near]; nEntry < grid.cellStart[near + 1]; ++nEntry)
+                {
+                    int nMol = grid.cellMols[nEntry];
+                    if (!molArrays.weight[nMol]) continue;
+
+                    double dx = molArrays.x[nMol] - pos.x, dy = molArrays.y[nMol] - pos.y;
+                    double dist2 = dx * dx + dy * dy;
+                    if (int(best.size()) < k)
+                    {
+                        best.push_back({dist2, nMol});
+                        std::push_heap(best.begin(), best.end());
+                    }
+                    else if (dist2 < best.front().first)
+                    {
+                        std::pop_heap(best.begin(), best.end());
+                        best.back() = {dist2, nMol};
+                        std::push_heap(best.begin(), best.end());
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort_heap(best.begin(), best.end());
+    std::vector<Molecule*> found;
+    for (const std::pair<double, int>& entry: best)
+        found.push_back(mols[entry.second]);
+    return found;
+}
+
+// Cells are wider than any molecule, so whatever covers pos sits in its own or an adjacent cell
+Molecule* Reactor::molAt(Vector pos)
+{
+    if (!gridFresh) refreshGrid();
+
+    Molecule* found = nullptr;
+    double foundDist2 = 0;
+    grid.visitNear(grid.cellIndex(pos), [&](int nMol)
+    {
+        double dx = molArrays.x[nMol] - pos.x, dy = molArrays.y[nMol] - pos.y, r = molArrays.r[nMol];
+        double dist2 = dx * dx + dy * dy;
+        if (molArrays.weight[nMol] && dist2 <= r * r && (!found || dist2 < foundDist2))
+        {
+            found = mols[nMol];
+            foundDist2 = dist2;
+        }
+        return true;
+    });
+    return found;
+}
+
+void Reactor::mousePressEvent(QGraphicsSceneMouseEvent* event)
+{
+    Molecule* mol = molAt(Vector(event->pos().x(), -event->pos().y(), 0));
+    if (!mol) return;
+
+    QString description = QString("%1 mass %2, v (%3, %4), age %5")
+                              .arg(mol->type == MOL_ROUND ? "round" : "square")
+                              .arg(mol->mass)
+                              .arg(mol->v.x, 0, 'f', 2)
+                              .arg(mol->v.y, 0, 'f', 2)
+                              .arg(tickCount - mol->born);
+    if (mol->weight > 1) description += QString(", x%1").arg(mol->weight);
+    emit molInspected(description);
+}
@@ -2,6 +2,11 @@
 #define REACTOR_H
 
 #include "myvector.h"
+#include "populate.h"
+#include "molgrid.h"
+#include "wallkernel.h"
+#include "fields.h"
+#include "cachedlayer.h"
 
 #include <QGraphicsObject>
 #include <QLabel>
@@ -21,10 +26,13 @@ enum MolStatus
     MOL_WALL_BOUNCE
 };
 
+extern QColor roundCol, squareCol;
+
 class Molecule;
 class RoundMol;
 class SquareMol;
 class Reactor;
+class Protocol;
 
 class Molecule
 {
@@ -32,12 +40,15 @@ public:
     MolStatus status;
     MolType type;
     int mass, r;
+    int weight; // number of real molecules this one stands for
     Vector v, pos;
+    long long born; // tick the molecule first took part in
 
     Molecule(int mass, Vector v, Vector pos, MolType type);
     virtual ~Molecule() = default;
 
-    virtual void collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule* other) = 0;
+    // explosions yield at most maxParts fragments, each carrying a share of the weight
+    virtual void collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule* other, int maxParts) = 0;
     virtual void draw(QPainter* painter) = 0;
 };
 
@@ -46,7 +57,7 @@ class RoundMol : public Molecule
 public:
     RoundMol(int mass, Vector v, Vector pos);
 
-    virtual void collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule* other);
+    virtual void collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule* other, int maxParts);
     virtual void draw(QPainter* painter);
 };
 
@@ -55,18 +66,41 @@ class SquareMol : public Molecule
 public:
     SquareMol(int mass, Vector v, Vector pos);
 
-    virtual void collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule* other);
+    virtual void collide(std::vector<Molecule*>& mols, Vector collidePos, Molecule* other, int maxParts);
     virtual void draw(QPainter* painter);
 };
 
-class Button : public QObject
+double molRadius(int mass);
+Molecule* newMolecule(MolType type, int mass, Vector v, Vector pos);
+Molecule* randMolecule(Vector lo, Vector hi);
+Molecule* randMolecule(double spawnP);
+void clearInvalidMols(std::vector<Molecule*>& mols);
+
+// Counts molecules whose path during a tick crosses the segment p1 -> p2, weighted by multiplicity.
+// Forward is from the left of p1 -> p2 to its right. Wall bounces within the tick are not followed.
+class LineProbe
+{
+public:
+    LineProbe(Vector p1, Vector p2);
+
+    Vector p1, p2;
+    double forward, backward;
+};
+
+// Drawn from its own cache, repainted only when pressed or released
+class Button : public QGraphicsObject
 {
     Q_OBJECT
 public:
-    Button(int xl, int yt, int xr, int yb, Vector color);
+    Button(int xl, int yt, int xr, int yb, Vector color, QGraphicsItem* parent);
     virtual void action();
     void unpress();
 
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+    virtual void mousePressEvent(QGraphicsSceneMouseEvent* event) override;
+    virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent* event) override;
+
     IntVector TL, BR;
     Vector press_color, unpress_color;
     bool is_pressed;
@@ -86,44 +120,96 @@ class Reactor : public QGraphicsObject
     Q_OBJECT;
 public:
     Reactor(int width);
+    Reactor(IntVector TL, IntVector BR);
     ~Reactor();
 
     QRectF boundingRect() const override;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
 
     virtual void mousePressEvent(QGraphicsSceneMouseEvent* event) override;
-    virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent* event) override;
 
     double energy();
     std::vector<double> molCnt();
 
+    // Spatial queries on the current state, answered from the grid kept since the end of the last tick.
+    // Results stay valid until the next step; periodic walls are not wrapped around.
+    std::vector<Molecule*> molsInRect(Vector lo, Vector hi);
+    std::vector<Molecule*> molsInCircle(Vector centre, double radius);
+    std::vector<Molecule*> nearestMols(Vector pos, int k); // closest first
+    Molecule* molAt(Vector pos);                           // the molecule covering pos, nullptr if none
+    int addProbe(Vector p1, Vector p2);
+
     void checkWallCollision(Molecule* mol);
+    bool setWalls(WallConfig config);
+    bool isOpen(WallSide side) const;
+    void reflectWalls(MolArrays& arrays);
+    void injectInflow();
+    void buildGrid(double minCellSize);
+    void refreshGrid();
+    void countProbes();
+    Vector nearestImage(Vector pos, Vector from) const;
     void checkMolCollision(Molecule* mol, Molecule* mol2);
+    void findMolCollision(int nMol);
+    void refineMols(int limit);
+
+    void step();
+    QByteArray snapshotFrame();
+    double collisionReach();
+    void reorderMols();
+    void fitMargin();
 
     void moveWall(int step);
     void increaseTemp(double step);
-    void addRandomMols(int nMols);
+    void addRandomMols(int nMols, double spawnP = 100);
+    int addMols(int nMols, Vector lo, Vector hi, PopulationSpec spec); // returns how many fit
 
     void addButton(Vector color);
 
 signals:
     void energySig(std::vector<double> enegry);
     void molCntSig(std::vector<double> cnt);
+    void stepped();
+    void fieldsSig(const FieldBins& fields);
+    void protocolStopped(QString reason);
+    void molInspected(QString description);
 
 public slots:
     void advance();
 
-private:
+protected:
     // int width, height;
     IntVector TL, BR;
     std::vector<Molecule*> mols;
+    MolGrid grid;
+    MolArrays molArrays;
+    double sortedLocality;
     QTimer* timer;
 
     std::vector<Button*> buttons;
-    double lftTemp, rgtImpulse;
+    CachedLayer* wallLayer;
+    int margin; // room the bounding rect leaves around the walls, at least the largest molecule radius
+    WallConfig walls;
+    WallKernel wallKernel;
+    double inflowDebt[nWallSides]; // molecules owed by each inflow wall, carried over between ticks
+    bool gridFresh; // grid and molArrays match mols, nothing changed since the end of the last tick
+    int gridMols;   // leading molecules the grid still finds where they are, the rest were appended since
+
+    std::vector<Molecule*> gridMolsInRect(Vector lo, Vector hi); // no refresh, only the first gridMols
 
 public:
     QLabel* d;
+    bool reorderEnabled;
+    double lftTemp; // heater kick of thermostat walls
+    double rgtImpulse, lftHeat;
+    long long tickCount;
+    int molBudget; // population above which explosions make super-particles, 0 to never coarse-grain
+    PopulationSpec spawnSpec; // placement and velocities of spawned molecules
+    FieldBins fields;
+    int fieldPeriod; // ticks between field binning passes, 0 to never bin
+    double inflowDensity; // molecules per unit area in the reservoir behind inflow walls, at spawnSpec's temperature
+    double outflow;       // molecules taken by sinks so far
+    Protocol* protocol;   // scheduled actions and stop conditions run inside step(), nullptr for none
+    std::vector<LineProbe> probes;
 };
 
 #endif // REACTOR_H
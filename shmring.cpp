@@ -0,0 +1,104 @@
+#include "shmring.h"
+
+#include <sys/mman.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static size_t alignUp(size_t size) { return (size + 63) / 64 * 64; }
+
+ShmRing::ShmRing(size_t capacity)
+{
+    this->capacity = capacity;
+    this->head = this->tail = 0;
+}
+
+size_t ShmRing::footprint(size_t capacity)
+{
+    return alignUp(sizeof(ShmRing)) + alignUp(capacity);
+}
+
+ShmRing* ShmRing::create(void* place, size_t capacity)
+{
+    return new (place) ShmRing(capacity);
+}
+
+char* ShmRing::buffer()
+{
+    return reinterpret_cast<char*>(this) + alignUp(sizeof(ShmRing));
+}
+
+void ShmRing::write(const void* src, size_t size)
+{
+    const char* bytes = static_cast<const char*>(src);
+    uint64_t written = head.load(std::memory_order_relaxed);
+
+    while (size)
+    {
+        size_t space = capacity - (written - tail.load(std::memory_order_acquire));
+        if (!space)
+        {
+            sched_yield();
+            continue;
+        }
+
+        size_t offset = written % capacity;
+        size_t chunk = std::min({size, space, capacity - offset});
+        memcpy(buffer() + offset, bytes, chunk);
+
+        written += chunk;
+        bytes += chunk;
+        size -= chunk;
+        head.store(written, std::memory_order_release);
+    }
+}
+
+void ShmRing::read(void* dst, size_t size)
+{
+    char* bytes = static_cast<char*>(dst);
+    uint64_t taken = tail.load(std::memory_order_relaxed);
+
+    while (size)
+    {
+        size_t filled = head.load(std::memory_order_acquire) - taken;
+        if (!filled)
+        {
+            sched_yield();
+            continue;
+        }
+
+        size_t offset = taken % capacity;
+        size_t chunk = std::min({size, filled, capacity - offset});
+        memcpy(bytes, buffer() + offset, chunk);
+
+        taken += chunk;
+        bytes += chunk;
+        size -= chunk;
+        tail.store(taken, std::memory_order_release);
+    }
+}
+
+size_t ShmRing::readable()
+{
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+}
+
+void* mapShared(size_t size)
+{
+    void* place = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (place == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+    return place;
+}
+
+void unmapShared(void* place, size_t size)
+{
+    munmap(place, size);
+}
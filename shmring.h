@@ -0,0 +1,37 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Single-producer single-consumer byte ring living in memory shared between processes.
+// The object is placed at the start of its region and the data bytes follow it.
+class ShmRing
+{
+public:
+    static size_t footprint(size_t capacity);
+    static ShmRing* create(void* place, size_t capacity);
+
+    // both block (yielding the CPU) until the whole transfer is done
+    void write(const void* src, size_t size);
+    void read(void* dst, size_t size);
+
+    size_t readable();
+
+    template <class T> void write(const T& value) { write(&value, sizeof(T)); }
+    template <class T> T read() { T value; read(&value, sizeof(T)); return value; }
+
+private:
+    ShmRing(size_t capacity);
+    char* buffer();
+
+    size_t capacity;
+    std::atomic<uint64_t> head, tail; // bytes written and read so far
+};
+
+// Anonymous MAP_SHARED memory, inherited by processes forked after it is mapped
+void* mapShared(size_t size);
+void unmapShared(void* place, size_t size);
+
+#endif // SHMRING_H
@@ -0,0 +1,345 @@
+#include "slab.h"
+
+#include <QApplication>
+
+#include <sys/wait.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <new>
+
+const size_t linkCapacity = 1 << 25, coordCapacity = 1 << 16;
+const unsigned slabSeed = 1;
+
+static void sendMols(ShmRing* ring, const std::vector<Molecule*>& mols)
+{
+    std::vector<MolRecord> records;
+    records.reserve(mols.size());
+    for (Molecule* mol: mols)
+        records.push_back({mol->pos.x, mol->pos.y, mol->v.x, mol->v.y, mol->mass, mol->type, mol->weight});
+
+    ring->write(int(records.size()));
+    ring->write(records.data(), records.size() * sizeof(MolRecord));
+}
+
+static void receiveMols(ShmRing* ring, std::vector<Molecule*>& mols)
+{
+    std::vector<MolRecord> records(ring->read<int>());
+    ring->read(records.data(), records.size() * sizeof(MolRecord));
+
+    for (const MolRecord& record: records)
+    {
+        Molecule* mol = newMolecule(MolType(record.type), record.mass, Vector(record.vx, record.vy, 0),
+                                    Vector(record.x, record.y, 0));
+        mol->weight = record.weight;
+        mols.push_back(mol);
+    }
+}
+
+static void sendInts(ShmRing* ring, const std::vector<int>& values)
+{
+    ring->write(int(values.size()));
+    ring->write(values.data(), values.size() * sizeof(int));
+}
+
+static std::vector<int> receiveInts(ShmRing* ring)
+{
+    std::vector<int> values(ring->read<int>());
+    ring->read(values.data(), values.size() * sizeof(int));
+    return values;
+}
+
+SlabReactor::SlabReactor(SlabShared* shared, SlabLinks links, int rank, IntVector TL, IntVector BR, int nMols)
+    : Reactor(TL, BR)
+{
+    this->shared = shared;
+    this->links = links;
+    this->rank = rank;
+    setWalls(WallConfig(rank > 0 ? WALL_OPEN : WALL_THERMOSTAT, rank < shared->nSlabs - 1 ? WALL_OPEN : WALL_REFLECT));
+
+    mols.reserve(nMols);
+    int nPlaced = addMols(nMols, Vector(TL.x, BR.y * 0.8, 0), Vector(BR.x, TL.y * 0.8, 0), spawnSpec);
+    if (nPlaced < nMols) fprintf(stderr, "slab %d fits only %d of its %d molecules\n", rank, nPlaced, nMols);
+}
+
+void SlabReactor::barrier()
+{
+    int generation = shared->generation.load(std::memory_order_acquire);
+    if (shared->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == shared->nSlabs)
+    {
+        shared->arrived.store(0, std::memory_order_relaxed);
+        shared->generation.fetch_add(1, std::memory_order_release);
+        return;
+    }
+
+    // a crashed worker never arrives, the coordinator tells the rest through failed
+    while (shared->generation.load(std::memory_order_acquire) == generation && !shared->failed)
+        sched_yield();
+}
+
+double SlabReactor::globalReach(int nTick)
+{
+    double* reach = shared->reach[nTick % 2];
+    reach[rank] = collisionReach();
+    barrier();
+
+    double maxReach = 0;
+    for (int nSlab = 0; nSlab < shared->nSlabs; ++nSlab)
+        maxReach = std::max(maxReach, reach[nSlab]);
+    return maxReach;
+}
+
+void SlabReactor::sendHalo(double reach)
+{
+    haloSent.clear();
+    for (Molecule* mol: mols)
+        if (mol->pos.x < TL.x + reach) haloSent.push_back(mol);
+    sendMols(links.toLft, haloSent);
+}
+
+void SlabReactor::crossCollide(double reach)
+{
+    std::vector<Molecule*> ghosts;
+    receiveMols(links.fromRgt, ghosts);
+
+    MolArrays ghostArrays;
+    ghostArrays.gather(ghosts);
+    MolGrid ghostGrid;
+    ghostGrid.build(ghostArrays, IntVector(BR.x - reach, TL.y, 0), IntVector(BR.x + reach + 1, BR.y, 0), reach);
+
+    // both sides are still at their start-of-tick positions here
+    int nMols = mols.size();
+    for (int nMol = 0; nMol < nMols; ++nMol)
+    {
+        Molecule* mol = mols[nMol];
+        if (mol->pos.x < BR.x - reach || mol->status != MOL_VALID) continue;
+
+        ghostGrid.visitNear(ghostGrid.cellIndex(mol->pos), [&](int nGhost)
+        {
+            Molecule* ghost = ghosts[nGhost];
+            if (ghost->status != MOL_VALID) return true;
+
+            checkMolCollision(mol, ghost);
+            return mol->status != MOL_INVALID;
+        });
+    }
+
+    // products only move from the next tick on, so they sit out this step
+    crossProducts.assign(mols.begin() + nMols, mols.end());
+    mols.resize(nMols);
+
+    // (index, remaining weight) of every ghost that reacted
+    std::vector<int> reacted;
+    for (int nGhost = 0; nGhost < int(ghosts.size()); ++nGhost)
+    {
+        Molecule* ghost = ghosts[nGhost];
+        if (ghost->status == MOL_INVALID || ghost->weight != ghostArrays.weight[nGhost])
+        {
+            reacted.push_back(nGhost);
+            reacted.push_back(ghost->status == MOL_INVALID ? 0 : ghost->weight);
+        }
+        delete ghost;
+    }
+    sendInts(links.toRgt, reacted);
+}
+
+void SlabReactor::receiveReacted()
+{
+    std::vector<int> reacted = receiveInts(links.fromLft);
+    for (int nEntry = 0; nEntry < int(reacted.size()); nEntry += 2)
+    {
+        Molecule* mol = haloSent[reacted[nEntry]];
+        mol->weight = reacted[nEntry + 1];
+        if (!mol->weight) mol->status = MOL_INVALID;
+    }
+}
+
+void SlabReactor::migrate()
+{
+    std::vector<Molecule*> toLft, toRgt;
+    for (Molecule* mol: mols)
+    {
+        if (isOpen(WALL_LFT) && mol->pos.x < TL.x) toLft.push_back(mol);
+        else if (isOpen(WALL_RGT) && mol->pos.x >= BR.x) toRgt.push_back(mol);
+        else continue;
+        mol->status = MOL_INVALID;
+    }
+
+    if (isOpen(WALL_LFT)) sendMols(links.toLft, toLft);
+    if (isOpen(WALL_RGT)) sendMols(links.toRgt, toRgt);
+    clearInvalidMols(mols);
+
+    if (isOpen(WALL_LFT)) receiveMols(links.fromLft, mols);
+    if (isOpen(WALL_RGT)) receiveMols(links.fromRgt, mols);
+}
+
+bool SlabReactor::tick(int nTick)
+{
+    double reach = globalReach(nTick);
+    if (shared->failed) return false;
+
+    // every worker sees the same reach and width, so they all stop here together and failed stays for crashes;
+    // the first one to exit gets the rest killed, so none leaves before rank 0 has said why
+    if (2 * reach > shared->slabWidth)
+    {
+        if (rank == 0) fprintf(stderr, "slabs are narrower than twice the collision reach %.1lf\n", reach);
+        barrier();
+        return false;
+    }
+
+    if (isOpen(WALL_LFT)) sendHalo(reach);
+    if (isOpen(WALL_RGT)) crossCollide(reach);
+    if (isOpen(WALL_LFT)) receiveReacted();
+
+    // migration and halo reactions changed the molecules since the last step left its grid
+    gridFresh = false;
+    gridMols = 0;
+    step();
+
+    // products of reactions across the boundary join after the step, as in-slab ones do
+    for (Molecule* mol: crossProducts)
+        mol->born = tickCount;
+    mols.insert(mols.end(), crossProducts.begin(), crossProducts.end());
+    crossProducts.clear();
+    migrate();
+
+    std::vector<double> cnt = molCnt();
+    links.toCoord->write(SlabObservables{nTick, int(cnt[0]), int(cnt[1]), energy()});
+    return true;
+}
+
+SlabCoordinator::SlabCoordinator(SlabShared* shared, std::vector<ShmRing*> fromSlabs, std::vector<pid_t> workers)
+{
+    this->shared = shared;
+    this->fromSlabs = fromSlabs;
+    this->workers = workers;
+}
+
+// Reaps workers that are gone; on an abnormal exit stops the rest, which may be blocked on a ring the dead one fed
+bool SlabCoordinator::workerFailed()
+{
+    for (pid_t& pid: workers)
+    {
+        int status = 0;
+        if (pid <= 0 || waitpid(pid, &status, WNOHANG) != pid) continue;
+
+        pid = 0;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+        if (WIFSIGNALED(status)) fprintf(stderr, "slab worker killed by signal %d\n", WTERMSIG(status));
+        shared->failed = 1;
+    }
+
+    if (!shared->failed) return false;
+    for (pid_t pid: workers)
+        if (pid > 0) kill(pid, SIGKILL);
+    return true;
+}
+
+bool SlabCoordinator::gather(int nTicks)
+{
+    for (int nTick = 0; nTick < nTicks; ++nTick)
+    {
+        double energy = 0, round = 0, square = 0;
+        for (ShmRing* ring: fromSlabs)
+        {
+            while (ring->readable() < sizeof(SlabObservables))
+            {
+                if (workerFailed()) return false;
+                sched_yield();
+            }
+
+            SlabObservables obs = ring->read<SlabObservables>();
+            energy += obs.energy;
+            round += obs.round;
+            square += obs.square;
+        }
+
+        emit energySig({energy});
+        emit molCntSig({round, square});
+    }
+    return true;
+}
+
+static int runSlabWorker(int argc, char** argv, SlabShared* shared, SlabLinks links, int rank,
+                         IntVector TL, IntVector BR, int nMols, int nTicks)
+{
+    // Reactor owns widgets, so the worker needs an application object but never a display
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    srand(slabSeed + rank);
+    SlabReactor reactor(shared, links, rank, TL, BR, nMols);
+
+    for (int nTick = 0; nTick < nTicks; ++nTick)
+        if (!reactor.tick(nTick)) return 1;
+    return 0;
+}
+
+int runSlabs(int argc, char** argv, int nSlabs, int width, int nMols, int nTicks)
+{
+    nSlabs = std::clamp(nSlabs, 1, maxSlabs);
+
+    size_t headerSize = (sizeof(SlabShared) + 63) / 64 * 64;
+    size_t linkSize = ShmRing::footprint(linkCapacity), coordSize = ShmRing::footprint(coordCapacity);
+    size_t size = headerSize + 2 * (nSlabs - 1) * linkSize + nSlabs * coordSize;
+    char* region = static_cast<char*>(mapShared(size));
+
+    SlabShared* shared = new (region) SlabShared();
+    shared->nSlabs = nSlabs;
+    shared->slabWidth = 2 * width / nSlabs;
+
+    char* place = region + headerSize;
+    std::vector<ShmRing*> toRgt(nSlabs), toLft(nSlabs), toCoord(nSlabs);
+    for (int nSlab = 0; nSlab < nSlabs; ++nSlab)
+    {
+        if (nSlab < nSlabs - 1)
+        {
+            toRgt[nSlab] = ShmRing::create(place, linkCapacity);
+            toLft[nSlab + 1] = ShmRing::create(place + linkSize, linkCapacity);
+            place += 2 * linkSize;
+        }
+        toCoord[nSlab] = ShmRing::create(place, coordCapacity);
+        place += coordSize;
+    }
+
+    std::vector<pid_t> workers;
+    for (int nSlab = 0; nSlab < nSlabs; ++nSlab)
+    {
+        SlabLinks links;
+        links.toLft = toLft[nSlab];
+        links.toRgt = toRgt[nSlab];
+        links.fromLft = nSlab > 0 ? toRgt[nSlab - 1] : nullptr;
+        links.fromRgt = nSlab < nSlabs - 1 ? toLft[nSlab + 1] : nullptr;
+        links.toCoord = toCoord[nSlab];
+
+        int xl = -width + nSlab * shared->slabWidth;
+        int xr = nSlab == nSlabs - 1 ? width : xl + shared->slabWidth;
+
+        pid_t pid = fork();
+        if (pid == 0)
+            _exit(runSlabWorker(argc, argv, shared, links, nSlab, IntVector(xl, width, 0), IntVector(xr, -width, 0),
+                                nMols / nSlabs + (nSlab < nMols % nSlabs), nTicks));
+        workers.push_back(pid);
+    }
+
+    SlabCoordinator coordinator(shared, toCoord, workers);
+    int nTick = 0;
+    double energy = 0;
+    QObject::connect(&coordinator, &SlabCoordinator::energySig, [&](std::vector<double> total)
+    {
+        energy = total[0];
+    });
+    QObject::connect(&coordinator, &SlabCoordinator::molCntSig, [&](std::vector<double> cnt)
+    {
+        printf("%d %.1lf %.0lf %.0lf\n", nTick++, energy, cnt[0], cnt[1]);
+        fflush(stdout);
+    });
+    bool done = coordinator.gather(nTicks);
+
+    for (pid_t pid: workers)
+        waitpid(pid, nullptr, 0);
+    unmapShared(region, size);
+    return done ? 0 : 1;
+}
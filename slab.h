@@ -0,0 +1,87 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "reactor.h"
+#include "shmring.h"
+
+#include <sys/types.h>
+
+// Domain decomposition of one reactor box into vertical slabs, each stepped by its own
+// forked worker process. Neighbouring workers talk through shared-memory rings:
+//   right -> left: halo (molecules near the shared boundary), then migrants
+//   left -> right: new weights of halo molecules that reacted across the boundary (0 when consumed), then migrants
+// Reactions across a boundary are resolved by the slab on its left.
+
+const int maxSlabs = 64;
+
+struct MolRecord
+{
+    double x, y, vx, vy;
+    int mass, type, weight;
+};
+
+struct SlabObservables
+{
+    int tick, round, square;
+    double energy;
+};
+
+struct SlabShared
+{
+    int nSlabs, slabWidth;
+    std::atomic<int> arrived, generation, failed;
+    double reach[2][maxSlabs]; // indexed by tick parity, so a fast worker never overwrites a value still being read
+};
+
+class SlabLinks
+{
+public:
+    ShmRing *toLft, *toRgt, *fromLft, *fromRgt, *toCoord;
+};
+
+class SlabReactor : public Reactor
+{
+public:
+    SlabReactor(SlabShared* shared, SlabLinks links, int rank, IntVector TL, IntVector BR, int nMols);
+
+    bool tick(int nTick);
+
+private:
+    void barrier();
+    double globalReach(int nTick);
+
+    void sendHalo(double reach);
+    void crossCollide(double reach);
+    void receiveReacted();
+    void migrate();
+
+    SlabShared* shared;
+    SlabLinks links;
+    int rank;
+    std::vector<Molecule*> haloSent;
+    std::vector<Molecule*> crossProducts; // made by crossCollide, appended once the step is done
+};
+
+class SlabCoordinator : public QObject
+{
+    Q_OBJECT
+public:
+    SlabCoordinator(SlabShared* shared, std::vector<ShmRing*> fromSlabs, std::vector<pid_t> workers);
+
+    bool gather(int nTicks);
+    bool workerFailed();
+
+signals:
+    void energySig(std::vector<double> enegry);
+    void molCntSig(std::vector<double> cnt);
+
+private:
+    SlabShared* shared;
+    std::vector<ShmRing*> fromSlabs;
+    std::vector<pid_t> workers; // 0 once reaped
+};
+
+// Headless run over nSlabs worker processes; prints the gathered observables every tick
+int runSlabs(int argc, char** argv, int nSlabs, int width, int nMols, int nTicks);
+
+#endif // SLAB_H
@@ -0,0 +1,234 @@
+#include "snapshot.h"
+#include "reactor.h"
+
+#include <QApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QPainter>
+#include <QTimer>
+
+#include <algorithm>
+#include <cstring>
+
+const int quantLevels = 65535, maxRadius = 0x7fff, reconnectMs = 500, minViewMargin = 5;
+
+static uint16_t quantize(double coord, double lo, double hi)
+{
+    double t = (coord - lo) / std::max(hi - lo, 1.0);
+    return std::clamp(t, 0.0, 1.0) * quantLevels + 0.5;
+}
+
+QByteArray encodeSnapshot(const SnapshotHeader& header, const std::vector<Molecule*>& mols)
+{
+    QByteArray data(sizeof(SnapshotHeader) + mols.size() * sizeof(SnapshotMol), Qt::Uninitialized);
+
+    SnapshotHeader* head = reinterpret_cast<SnapshotHeader*>(data.data());
+    *head = header;
+    head->magic = snapshotMagic;
+    head->size = data.size();
+    head->nMols = mols.size();
+
+    SnapshotMol* packed = reinterpret_cast<SnapshotMol*>(head + 1);
+    for (Molecule* mol: mols)
+    {
+        packed->x = quantize(mol->pos.x, header.tlX, header.brX);
+        packed->y = quantize(mol->pos.y, header.brY, header.tlY);
+        packed->rType = std::min(mol->r, maxRadius) | (mol->type == MOL_SQUARE ? 0x8000 : 0);
+        ++packed;
+    }
+    return data;
+}
+
+bool decodeSnapshot(const char* data, SnapshotFrame& frame)
+{
+    memcpy(&frame.header, data, sizeof(SnapshotHeader));
+    if (frame.header.magic != snapshotMagic) return false;
+    if (frame.header.size != sizeof(SnapshotHeader) + frame.header.nMols * sizeof(SnapshotMol)) return false;
+
+    frame.mols.resize(frame.header.nMols);
+    memcpy(frame.mols.data(), data + sizeof(SnapshotHeader), frame.mols.size() * sizeof(SnapshotMol));
+    return true;
+}
+
+SnapshotPublisher::SnapshotPublisher(Reactor* reactor, QString name)
+{
+    this->reactor = reactor;
+    this->nSent = this->nDropped = 0;
+
+    QLocalServer::removeServer(name);
+    server = new QLocalServer(this);
+    server->listen(name);
+
+    QObject::connect(server, &QLocalServer::newConnection, this, [this]
+    {
+        while (QLocalSocket* viewer = server->nextPendingConnection())
+        {
+            viewers.push_back(viewer);
+            QObject::connect(viewer, &QLocalSocket::disconnected, this, [this, viewer]
+            {
+                viewers.erase(std::find(viewers.begin(), viewers.end(), viewer));
+                viewer->deleteLater();
+            });
+        }
+    });
+    QObject::connect(reactor, &Reactor::stepped, this, &SnapshotPublisher::publish);
+}
+
+void SnapshotPublisher::publish()
+{
+    std::vector<QLocalSocket*> ready;
+    for (QLocalSocket* viewer: viewers)
+    {
+        if (viewer->bytesToWrite() > 0) ++nDropped;
+        else ready.push_back(viewer);
+    }
+    if (ready.empty()) return;
+
+    QByteArray frame = reactor->snapshotFrame();
+    for (QLocalSocket* viewer: ready)
+    {
+        viewer->write(frame);
+        ++nSent;
+    }
+}
+
+SnapshotView::SnapshotView(QString name)
+{
+    this->name = name;
+    this->frame.header = SnapshotHeader();
+    this->lastTick = -1;
+    this->nMissed = 0;
+    this->reconnectPending = false;
+    this->margin = minViewMargin;
+
+    wallLayer = new CachedLayer(this, [this]{ return boundingRect(); }, [this](QPainter* painter)
+    {
+        const SnapshotHeader& box = frame.header;
+        painter->setPen(QPen(Qt::black, 3));
+        painter->setBrush(Qt::transparent);
+        painter->drawRect(box.tlX, -box.tlY, box.brX - box.tlX, box.tlY - box.brY);
+    });
+
+    socket = new QLocalSocket(this);
+    QObject::connect(socket, &QLocalSocket::readyRead, this, &SnapshotView::receive);
+    QObject::connect(socket, &QLocalSocket::disconnected, this, &SnapshotView::reconnectLater);
+    QObject::connect(socket, &QLocalSocket::errorOccurred, this, &SnapshotView::reconnectLater);
+    connectToPublisher();
+}
+
+// a lost publisher usually signals both an error and a disconnect, they share one retry
+void SnapshotView::reconnectLater()
+{
+    if (reconnectPending) return;
+    reconnectPending = true;
+    QTimer::singleShot(reconnectMs, this, &SnapshotView::connectToPublisher);
+}
+
+void SnapshotView::connectToPublisher()
+{
+    // abort() emits disconnected on a live socket, which must not schedule yet another reconnect
+    reconnectPending = true;
+    socket->abort();
+    reconnectPending = false;
+
+    pending.clear();
+    lastTick = -1;
+    socket->connectToServer(name, QIODevice::ReadOnly);
+}
+
+void SnapshotView::receive()
+{
+    pending += socket->readAll();
+
+    // keep only the newest complete frame, older ones are stale by now
+    int offset = 0, latest = -1;
+    while (pending.size() - offset >= int(sizeof(SnapshotHeader)))
+    {
+        SnapshotHeader header;
+        memcpy(&header, pending.constData() + offset, sizeof(SnapshotHeader));
+        // a size that does not cover the header and the molecules would stall offset, so resync like a bad magic
+        if (header.magic != snapshotMagic || header.size < sizeof(SnapshotHeader) ||
+            header.size != sizeof(SnapshotHeader) + uint64_t(header.nMols) * sizeof(SnapshotMol))
+        {
+            pending.clear();
+            socket->abort();
+            reconnectLater();
+            return;
+        }
+        if (pending.size() - offset < int(header.size)) break;
+
+        latest = offset;
+        offset += header.size;
+    }
+    if (latest < 0) return;
+
+    SnapshotFrame newFrame;
+    bool valid = decodeSnapshot(pending.constData() + latest, newFrame);
+    pending.remove(0, offset);
+    if (!valid) return;
+
+    // ticks dropped by the publisher and frames skipped here both show up as a gap in tick numbers
+    if (lastTick >= 0) nMissed += newFrame.header.tick - lastTick - 1;
+    lastTick = newFrame.header.tick;
+
+    // molecules on a wall reach past it by their radius, so the margin grows with the largest one seen
+    int newMargin = margin;
+    for (const SnapshotMol& mol: newFrame.mols)
+        newMargin = std::max(newMargin, (mol.rType & maxRadius) + 1);
+
+    // the walls only need redrawing when the box or the margin changed
+    const SnapshotHeader& box = frame.header;
+    bool moved = box.tlX != newFrame.header.tlX || box.tlY != newFrame.header.tlY || box.brX != newFrame.header.brX ||
+                 box.brY != newFrame.header.brY || newMargin != margin;
+
+    if (moved)
+    {
+        prepareGeometryChange();
+        wallLayer->prepareChange();
+    }
+    frame.header = newFrame.header;
+    frame.mols.swap(newFrame.mols);
+    margin = newMargin;
+    if (moved) wallLayer->refresh();
+    update();
+
+    emit energySig({frame.header.energy});
+    emit molCntSig({frame.header.round, frame.header.square});
+    emit frameSig(frame.header.tick, nMissed);
+}
+
+QRectF SnapshotView::boundingRect() const
+{
+    const SnapshotHeader& box = frame.header;
+    return QRect(box.tlX - margin, -(box.tlY + margin), box.brX - box.tlX + 2 * margin, box.tlY - box.brY + 2 * margin);
+}
+
+Vector SnapshotView::toScene(const SnapshotMol& mol) const
+{
+    const SnapshotHeader& box = frame.header;
+    return Vector(box.tlX + mol.x * double(box.brX - box.tlX) / quantLevels,
+                  box.brY + mol.y * double(box.tlY - box.brY) / quantLevels, 0);
+}
+
+void SnapshotView::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    painter->setPen(QPen(Qt::transparent, 0));
+
+    for (const SnapshotMol& mol: frame.mols)
+    {
+        Vector pos = toScene(mol);
+        int r = mol.rType & maxRadius;
+        painter->setBrush(mol.rType & 0x8000 ? squareCol : roundCol);
+        painter->drawEllipse(QPointF(pos.x, -pos.y), r, r);
+    }
+}
+
+int runPublisher(int argc, char** argv, QString name, int width)
+{
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    Reactor reactor(width);
+    SnapshotPublisher publisher(&reactor, name);
+    return app.exec();
+}
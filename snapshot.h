@@ -0,0 +1,104 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "myvector.h"
+#include "cachedlayer.h"
+
+#include <QGraphicsObject>
+#include <QByteArray>
+
+#include <cstdint>
+#include <vector>
+
+class Molecule;
+class Reactor;
+class QLocalServer;
+class QLocalSocket;
+
+// Wire format of one frame: a header followed by nMols packed molecules.
+// Positions are quantized to 16 bits over the box, radius and type share the third field.
+
+const uint32_t snapshotMagic = 0x52454143;
+
+struct SnapshotHeader
+{
+    uint32_t magic, size; // size of the whole frame, header included
+    int64_t tick;
+    int32_t tlX, tlY, brX, brY;
+    int32_t nMols;
+    double energy, round, square, lftTemp, rgtImpulse, lftHeat;
+};
+
+struct SnapshotMol
+{
+    uint16_t x, y;
+    uint16_t rType; // radius in the low 15 bits, MolType in the top one
+};
+
+class SnapshotFrame
+{
+public:
+    SnapshotHeader header;
+    std::vector<SnapshotMol> mols;
+};
+
+QByteArray encodeSnapshot(const SnapshotHeader& header, const std::vector<Molecule*>& mols);
+bool decodeSnapshot(const char* data, SnapshotFrame& frame);
+
+// Streams a frame of the reactor to every connected viewer after each tick.
+// A viewer that has not taken the previous frame yet simply misses this one, so the simulation never waits.
+class SnapshotPublisher : public QObject
+{
+    Q_OBJECT
+public:
+    SnapshotPublisher(Reactor* reactor, QString name);
+
+public slots:
+    void publish();
+
+private:
+    Reactor* reactor;
+    QLocalServer* server;
+    std::vector<QLocalSocket*> viewers;
+
+public:
+    long long nSent, nDropped;
+};
+
+// Scene item drawing the latest frame received from a publisher, in place of a live Reactor
+class SnapshotView : public QGraphicsObject
+{
+    Q_OBJECT
+public:
+    SnapshotView(QString name);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+signals:
+    void energySig(std::vector<double> enegry);
+    void molCntSig(std::vector<double> cnt);
+    void frameSig(long long tick, long long nMissed);
+
+private slots:
+    void connectToPublisher();
+    void receive();
+
+private:
+    void reconnectLater();
+    Vector toScene(const SnapshotMol& mol) const;
+
+    QString name;
+    QLocalSocket* socket;
+    QByteArray pending;
+    SnapshotFrame frame;
+    long long lastTick, nMissed;
+    bool reconnectPending; // a reconnect is scheduled or under way, further requests are dropped
+    int margin; // room around the walls for the wall pen and the largest molecule seen
+    CachedLayer* wallLayer;
+};
+
+// Headless simulation publishing snapshots under the given local socket name
+int runPublisher(int argc, char** argv, QString name, int width);
+
+#endif // SNAPSHOT_H
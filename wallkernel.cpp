@@ -0,0 +1,216 @@
+#include "wallkernel.h"
+#include "reactor.h"
+
+#include <algorithm>
+#include <cmath>
+
+void MolArrays::gather(const std::vector<Molecule*>& mols)
+{
+    size = mols.size();
+    x.resize(size);
+    y.resize(size);
+    vx.resize(size);
+    vy.resize(size);
+    mass.resize(size);
+    r.resize(size);
+    weight.resize(size);
+    bounce.resize(size);
+
+    for (int nMol = 0; nMol < size; ++nMol)
+    {
+        Molecule* mol = mols[nMol];
+        x[nMol] = mol->pos.x;
+        y[nMol] = mol->pos.y;
+        vx[nMol] = mol->v.x;
+        vy[nMol] = mol->v.y;
+        mass[nMol] = mol->mass;
+        r[nMol] = mol->r;
+        weight[nMol] = mol->status == MOL_INVALID ? 0 : mol->weight;
+    }
+}
+
+double MolArrays::collisionReach(double dt) const
+{
+    double maxR = 0, maxV2 = 0;
+    for (int nMol = 0; nMol < size; ++nMol)
+    {
+        maxR = std::max(maxR, r[nMol]);
+        maxV2 = std::max(maxV2, vx[nMol] * vx[nMol] + vy[nMol] * vy[nMol]);
+    }
+
+    // both partners are tested from their start-of-tick positions
+    return 2 * maxR + 2 * std::sqrt(maxV2) * dt;
+}
+
+void MolArrays::scatter(const std::vector<Molecule*>& mols)
+{
+    for (int nMol = 0; nMol < size; ++nMol)
+    {
+        Molecule* mol = mols[nMol];
+        if (mol->status == MOL_INVALID) continue;
+        mol->pos = Vector(x[nMol], y[nMol], 0);
+        mol->v = Vector(vx[nMol], vy[nMol], 0);
+    }
+}
+
+WallConfig::WallConfig(WallPolicy lft, WallPolicy rgt, WallPolicy top, WallPolicy bottom)
+{
+    policy[WALL_LFT] = lft;
+    policy[WALL_RGT] = rgt;
+    policy[WALL_TOP] = top;
+    policy[WALL_BOTTOM] = bottom;
+}
+
+// Wall policies. Each resolves one wall for one molecule with selects only: `hit` tells whether the molecule
+// crossed it, `bound` is the wall coordinate, `period` the box length along the axis and `dir` the outward normal.
+class Reflect
+{
+public:
+    static const WallPolicy policy = WALL_REFLECT;
+    static const bool active = true, pushes = true, heats = false, absorbs = false;
+
+    static double pos(bool hit, double x, double bound, double period, double dir) { return hit ? 2 * bound - x : x; }
+    static double vel(bool hit, double v, double mass, double temp, double dir) { return hit ? -v : v; }
+};
+
+class Thermostat : public Reflect
+{
+public:
+    static const WallPolicy policy = WALL_THERMOSTAT;
+    static const bool heats = true;
+
+    static double vel(bool hit, double v, double mass, double temp, double dir) { return hit ? -v - dir * temp / mass : v; }
+};
+
+class Periodic
+{
+public:
+    static const WallPolicy policy = WALL_PERIODIC;
+    static const bool active = true, pushes = false, heats = false, absorbs = false;
+
+    static double pos(bool hit, double x, double bound, double period, double dir) { return hit ? x - dir * period : x; }
+    static double vel(bool hit, double v, double mass, double temp, double dir) { return v; }
+};
+
+// inflow walls run this one too, the reservoir side is handled by Reactor
+class Absorb
+{
+public:
+    static const WallPolicy policy = WALL_ABSORB;
+    static const bool active = true, pushes = false, heats = false, absorbs = true;
+
+    static double pos(bool hit, double x, double bound, double period, double dir) { return x; }
+    static double vel(bool hit, double v, double mass, double temp, double dir) { return v; }
+};
+
+class Open
+{
+public:
+    static const WallPolicy policy = WALL_OPEN;
+    static const bool active = false, pushes = false, heats = false, absorbs = false;
+
+    static double pos(bool hit, double x, double bound, double period, double dir) { return x; }
+    static double vel(bool hit, double v, double mass, double temp, double dir) { return v; }
+};
+
+template <class Lft, class Rgt, class Top, class Bottom>
+static WallSums stepWalls(MolArrays& arrays, double dt, const double* bounds, double heaterTemp)
+{
+    double* x = arrays.x.data();
+    double* y = arrays.y.data();
+    double* vx = arrays.vx.data();
+    double* vy = arrays.vy.data();
+    const double* mass = arrays.mass.data();
+    const double* weight = arrays.weight.data();
+    unsigned char* bounce = arrays.bounce.data();
+
+    double lft = bounds[WALL_LFT], rgt = bounds[WALL_RGT], top = bounds[WALL_TOP], bottom = bounds[WALL_BOTTOM];
+    double width = rgt - lft, height = top - bottom;
+    double impulseL = 0, impulseR = 0, impulseT = 0, impulseB = 0, heatL = 0, heatR = 0, heatT = 0, heatB = 0;
+    double absorbedL = 0, absorbedR = 0, absorbedT = 0, absorbedB = 0;
+    int size = arrays.size;
+
+    // selects instead of branches, so the loop compiles to masked vector arithmetic;
+    // whatever a policy does not need is cut at compile time
+    #pragma omp simd reduction(+:impulseL, impulseR, impulseT, impulseB, heatL, heatR, heatT, heatB, \
+                                 absorbedL, absorbedR, absorbedT, absorbedB)
+    for (int i = 0; i < size; ++i)
+    {
+        double newX = x[i] + vx[i] * dt, newY = y[i] + vy[i] * dt;
+        double vx0 = vx[i], vy0 = vy[i], m = mass[i], w = weight[i];
+
+        bool hitR = Rgt::active & (newX > rgt), hitL = Lft::active & (newX < lft) & !hitR;
+        bool hitT = Top::active & (newY > top), hitB = Bottom::active & (newY < bottom) & !hitT;
+
+        double newVx = Lft::vel(hitL, Rgt::vel(hitR, vx0, m, heaterTemp, 1), m, heaterTemp, -1);
+        double newVy = Bottom::vel(hitB, Top::vel(hitT, vy0, m, heaterTemp, 1), m, heaterTemp, -1);
+
+        if constexpr (Lft::pushes) impulseL += hitL ? -w * m * vx0 : 0;
+        if constexpr (Rgt::pushes) impulseR += hitR ? w * m * vx0 : 0;
+        if constexpr (Top::pushes) impulseT += hitT ? w * m * vy0 : 0;
+        if constexpr (Bottom::pushes) impulseB += hitB ? -w * m * vy0 : 0;
+
+        if constexpr (Lft::heats) heatL += hitL ? w * m * (newVx * newVx - vx0 * vx0) / 2 : 0;
+        if constexpr (Rgt::heats) heatR += hitR ? w * m * (newVx * newVx - vx0 * vx0) / 2 : 0;
+        if constexpr (Top::heats) heatT += hitT ? w * m * (newVy * newVy - vy0 * vy0) / 2 : 0;
+        if constexpr (Bottom::heats) heatB += hitB ? w * m * (newVy * newVy - vy0 * vy0) / 2 : 0;
+
+        if constexpr (Lft::absorbs) absorbedL += hitL ? w : 0;
+        if constexpr (Rgt::absorbs) absorbedR += hitR ? w : 0;
+        if constexpr (Top::absorbs) absorbedT += hitT ? w : 0;
+        if constexpr (Bottom::absorbs) absorbedB += hitB ? w : 0;
+
+        x[i] = Lft::pos(hitL, Rgt::pos(hitR, newX, rgt, width, 1), lft, width, -1);
+        y[i] = Bottom::pos(hitB, Top::pos(hitT, newY, top, height, 1), bottom, height, -1);
+        vx[i] = newVx;
+        vy[i] = newVy;
+
+        bool bounced = (Lft::pushes & hitL) | (Rgt::pushes & hitR) | (Top::pushes & hitT) | (Bottom::pushes & hitB);
+        bool absorbed = (Lft::absorbs & hitL) | (Rgt::absorbs & hitR) | (Top::absorbs & hitT) | (Bottom::absorbs & hitB);
+        bounce[i] = (bounced ? BOUNCE_WALL : 0) | (absorbed ? BOUNCE_ABSORBED : 0);
+    }
+
+    return {{impulseL, impulseR, impulseT, impulseB}, {heatL, heatR, heatT, heatB},
+            {absorbedL, absorbedR, absorbedT, absorbedB}};
+}
+
+class WallKernelEntry
+{
+public:
+    WallPolicy policy[nWallSides];
+    WallKernel kernel;
+};
+
+template <class Lft, class Rgt, class Top, class Bottom> static WallKernelEntry wallKernel()
+{
+    return {{Lft::policy, Rgt::policy, Top::policy, Bottom::policy}, &stepWalls<Lft, Rgt, Top, Bottom>};
+}
+
+// The combinations the program can run (left, right, top, bottom), one kernel each.
+// Add a line here to support another one.
+static const WallKernelEntry wallKernels[] =
+{
+    wallKernel<Thermostat, Reflect, Reflect, Reflect>(), // the default box: heater on the left, gauge on the right
+    wallKernel<Reflect, Reflect, Reflect, Reflect>(),
+    wallKernel<Thermostat, Open, Reflect, Reflect>(),    // slabs
+    wallKernel<Open, Open, Reflect, Reflect>(),
+    wallKernel<Open, Reflect, Reflect, Reflect>(),
+    wallKernel<Periodic, Periodic, Periodic, Periodic>(), // bulk gas
+    wallKernel<Periodic, Periodic, Reflect, Reflect>(),   // channel between plates
+    wallKernel<Thermostat, Reflect, Periodic, Periodic>(), // heat conduction without side walls
+    wallKernel<Thermostat, Absorb, Periodic, Periodic>(),
+    wallKernel<Thermostat, Absorb, Reflect, Reflect>(),
+    wallKernel<Absorb, Absorb, Periodic, Periodic>(),     // inflow to outflow
+    wallKernel<Absorb, Absorb, Reflect, Reflect>(),
+};
+
+WallKernel selectWallKernel(const WallConfig& config)
+{
+    WallPolicy wanted[nWallSides];
+    for (int side = 0; side < nWallSides; ++side)
+        wanted[side] = config.policy[side] == WALL_INFLOW ? WALL_ABSORB : config.policy[side];
+
+    for (const WallKernelEntry& entry: wallKernels)
+        if (std::equal(wanted, wanted + nWallSides, entry.policy)) return entry.kernel;
+    return nullptr;
+}
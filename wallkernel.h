@@ -0,0 +1,70 @@
+#ifndef WALLKERNEL_H
+#define WALLKERNEL_H
+
+#include <vector>
+
+class Molecule;
+
+// Molecule state copied into contiguous arrays for the bulk kernels
+class MolArrays
+{
+public:
+    void gather(const std::vector<Molecule*>& mols);
+    double collisionReach(double dt) const;
+    void scatter(const std::vector<Molecule*>& mols); // writes back every molecule not consumed meanwhile
+
+    int size;
+    std::vector<double> x, y, vx, vy, mass, r;
+    std::vector<double> weight; // multiplicity, 0 for molecules already consumed this tick
+    std::vector<unsigned char> bounce;
+};
+
+const int nWallSides = 4;
+
+enum WallSide
+{
+    WALL_LFT,
+    WALL_RGT,
+    WALL_TOP,
+    WALL_BOTTOM
+};
+
+enum WallPolicy
+{
+    WALL_REFLECT,
+    WALL_THERMOSTAT, // reflects and kicks the molecule back by the heater temperature
+    WALL_PERIODIC,   // wraps to the opposite wall, which has to be periodic too
+    WALL_ABSORB,     // removes every molecule that crosses it
+    WALL_INFLOW,     // a sink that also lets molecules in from a reservoir behind it
+    WALL_OPEN        // left to a neighbouring slab
+};
+
+// bounce flags set by the kernels
+const unsigned char BOUNCE_WALL = 1, BOUNCE_ABSORBED = 2;
+
+class WallConfig
+{
+public:
+    WallConfig(WallPolicy lft = WALL_THERMOSTAT, WallPolicy rgt = WALL_REFLECT, WallPolicy top = WALL_REFLECT,
+               WallPolicy bottom = WALL_REFLECT);
+
+    WallPolicy policy[nWallSides];
+};
+
+class WallSums
+{
+public:
+    double impulse[nWallSides];  // normal momentum given to each wall
+    double heat[nWallSides];     // energy injected by each thermostat
+    double absorbed[nWallSides]; // molecules taken by each sink
+};
+
+// Advances every molecule by dt and resolves each wall it crossed, both axes in the same step.
+// bounds are the wall coordinates by WallSide. Every thermostat wall kicks by heaterTemp.
+typedef WallSums (*WallKernel)(MolArrays& arrays, double dt, const double* bounds, double heaterTemp);
+
+// The kernel compiled for this combination of policies, nullptr if it is not one of the instantiated ones.
+// With the default config it matches Reactor::checkWallCollision bit for bit on positions and velocities.
+WallKernel selectWallKernel(const WallConfig& config);
+
+#endif // WALLKERNEL_H